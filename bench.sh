@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# bench.sh
+# Multithreaded OS Simulation
+#
+# Runs a fixed matrix of schedulers and CPU counts on a large workload and
+# prints one line of CSV per run, for tracking the simulator's performance
+# across changes:
+#
+#   scheduler,cpus,processes,ticks,context_switches,wall_s,ticks_per_s
+#
+# ticks is the simulated time of the run, wall_s the real time it took.
+# The runs are quiet (-q), so the time is the simulation's, not the Gantt
+# chart's.
+#
+# Usage: ./bench.sh [simulator] [workload copies]
+#
+
+sim=${1:-./os-sim-release}
+copies=${2:-32}
+processes=$((copies * 8))
+
+echo "scheduler,cpus,processes,ticks,context_switches,wall_s,ticks_per_s"
+
+for sched in "fifo:" "rr:-r 4" "priority:-p" "mlfq:-m 4 10"; do
+  name=${sched%%:*}
+  args=${sched#*:}
+  for cpus in 1 2 4 8 16; do
+    start=$(date +%s.%N)
+    stats=$($sim $cpus $args -w $copies -q)
+    end=$(date +%s.%N)
+
+    # The stats are picked out by name, wherever they are in the output
+    echo "$stats" | awk -v name=$name -v cpus=$cpus -v procs=$processes \
+                        -v start=$start -v end=$end '
+      /^# of Context Switches:/ { switches = $NF }
+      /^Total execution time:/ { ticks = $(NF - 1) * 10 }
+      END {
+        wall = end - start
+        printf "%s,%d,%d,%d,%d,%.3f,%.0f\n", name, cpus, procs, ticks,
+               switches, wall, ticks / wall
+      }'
+  done
+done
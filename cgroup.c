@@ -0,0 +1,373 @@
+/*
+ * cgroup.c
+ * Multithreaded OS Simulation
+ *
+ * CPU bandwidth groups.  See cgroup.h for the interface.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgroup.h"
+#include "os-sim.h"
+#include "process.h"
+#include "prof.h"
+#include "student.h"
+
+static unsigned int cgroup_match(const char *name);
+static int cgroup_throttled(pcb_t *proc);
+static unsigned int cgroup_own_queued(int g);
+static unsigned long long cgroup_min_vtime(int parent, int except);
+static int cgroup_pick(void);
+static void cgroup_hold(void);
+static unsigned int cgroup_unhold(pcb_t **released);
+static void cgroup_report(void);
+
+#define CGROUP_VTIME_SCALE (1u << 20)
+#define CGROUP_NEVER 0xffffffffu
+
+/*
+ * cgroups[0] is the default group, of the processes no other group
+ * matches.  cgroup_turnaround[] holds how long each process took to
+ * terminate, or CGROUP_NEVER.
+ */
+static cgroup_t cgroups[CGROUP_MAX + 1];
+unsigned int cgroup_count = 0;
+static unsigned char *cgroup_of;
+static unsigned int *cgroup_turnaround;
+
+extern void cgroup_add(const char *prefix, unsigned int shares,
+                       unsigned int quota_ms, unsigned int period_ms) {
+  cgroup_count++;
+  cgroups[cgroup_count].prefix = prefix;
+  cgroups[cgroup_count].shares = shares;
+  cgroups[cgroup_count].quota = quota_ms / 100;
+  cgroups[cgroup_count].period = period_ms / 100;
+}
+
+extern void cgroup_print(void) {
+  unsigned int g;
+
+  for (g = 1; g <= cgroup_count; g++) {
+    if (cgroups[g].quota > 0)
+      printf("CPU group %s*: %u shares, %u ms every %u ms\n",
+             cgroups[g].prefix, cgroups[g].shares, cgroups[g].quota * 100,
+             cgroups[g].period * 100);
+    else
+      printf("CPU group %s*: %u shares, no quota\n", cgroups[g].prefix,
+             cgroups[g].shares);
+  }
+}
+
+extern int cgroup_init(void) {
+  unsigned int g, n, len;
+
+  cgroups[0].prefix = "";
+  cgroups[0].shares = CGROUP_DEFAULT_SHARES;
+  cgroups[0].period = 1;
+  for (g = 0; g <= cgroup_count; g++) {
+    cgroups[g].parent = -1;
+    for (n = 1; g > 0 && n <= cgroup_count; n++) {
+      len = strlen(cgroups[n].prefix);
+      if (n != g && strcmp(cgroups[n].prefix, cgroups[g].prefix) == 0) {
+        fprintf(stderr, "two CPU groups of %s*\n", cgroups[g].prefix);
+        return -1;
+      }
+      if (len < strlen(cgroups[g].prefix) &&
+          strncmp(cgroups[n].prefix, cgroups[g].prefix, len) == 0 &&
+          (cgroups[g].parent < 0 ||
+           len > strlen(cgroups[cgroups[g].parent].prefix)))
+        cgroups[g].parent = n;
+    }
+  }
+
+  cgroup_of = malloc(process_count);
+  cgroup_turnaround = malloc(sizeof(unsigned int) * process_count);
+  assert(cgroup_of != NULL && cgroup_turnaround != NULL);
+  for (n = 0; n < process_count; n++) {
+    cgroup_of[n] = cgroup_match(processes[n].name);
+    cgroup_turnaround[n] = CGROUP_NEVER;
+  }
+
+  simulator_scheduler_tick();
+  atexit(cgroup_report);
+  return 0;
+}
+
+/*
+ * cgroup_match returns the group with the longest prefix of a process
+ * name, or 0
+ */
+static unsigned int cgroup_match(const char *name) {
+  unsigned int g, best = 0;
+  size_t len;
+
+  for (g = 1; g <= cgroup_count; g++) {
+    len = strlen(cgroups[g].prefix);
+    if (strncmp(name, cgroups[g].prefix, len) == 0 &&
+        (best == 0 || len > strlen(cgroups[best].prefix)))
+      best = g;
+  }
+  return best;
+}
+
+/*
+ * cgroup_throttled returns whether a process's group, or any group over
+ * it, is throttled.  ready_mutex must be held
+ */
+static int cgroup_throttled(pcb_t *proc) {
+  int g;
+
+  for (g = cgroup_of[proc->pid]; g >= 0; g = cgroups[g].parent)
+    if (cgroups[g].throttled) return 1;
+  return 0;
+}
+
+extern int cgroup_held(pcb_t *proc) {
+  if (!cgroup_throttled(proc)) return 0;
+
+  /* held back until its group's period ends */
+  pcb_list_append(&cgroups[cgroup_of[proc->pid]].held, proc);
+  return 1;
+}
+
+/*
+ * cgroup_own_queued returns the processes of a group itself, rather than
+ * of the groups under it, on the ready queues.  ready_mutex must be held
+ */
+static unsigned int cgroup_own_queued(int g) {
+  unsigned int own = cgroups[g].queued, n;
+
+  for (n = 0; n <= cgroup_count; n++)
+    if (cgroups[n].parent == g) own -= cgroups[n].queued;
+  return own;
+}
+
+/*
+ * cgroup_min_vtime returns the least vtime of the groups under parent with
+ * processes queued, leaving out except, or ~0 if there are none.
+ * ready_mutex must be held
+ */
+static unsigned long long cgroup_min_vtime(int parent, int except) {
+  unsigned long long min = ~0ull;
+  unsigned int n;
+
+  for (n = 0; n <= cgroup_count; n++) {
+    if (cgroups[n].parent == parent && (int)n != except &&
+        cgroups[n].queued > 0 && cgroups[n].vtime < min)
+      min = cgroups[n].vtime;
+  }
+  return min;
+}
+
+/*
+ * A group that had nothing queued starts no further behind its queued
+ * siblings than the least of them, so that time spent waiting on I/O isn't
+ * saved up to shut them out later
+ */
+extern void cgroup_queued(pcb_t *proc, int delta) {
+  int g = cgroup_of[proc->pid];
+  unsigned long long floor;
+
+  if (delta > 0 && cgroup_own_queued(g) == 0) {
+    floor = cgroup_min_vtime(g, -1);
+    if (floor != ~0ull && cgroups[g].own_vtime < floor)
+      cgroups[g].own_vtime = floor;
+  }
+  for (; g >= 0; g = cgroups[g].parent) {
+    if (delta > 0 && cgroups[g].queued == 0) {
+      floor = cgroup_min_vtime(cgroups[g].parent, g);
+      if (floor != ~0ull && cgroups[g].vtime < floor) cgroups[g].vtime = floor;
+    }
+    cgroups[g].queued += delta;
+  }
+}
+
+/*
+ * cgroup_pick returns the group whose own processes should run next: going
+ * down from the top, at each level the group with processes queued, or the
+ * group's own processes, that has had the least CPU time for its shares.
+ * It returns -1 if nothing is queued.  ready_mutex must be held
+ */
+static int cgroup_pick(void) {
+  int g = -1, best;
+  unsigned int n;
+
+  while (1) {
+    best = -1;
+    for (n = 0; n <= cgroup_count; n++) {
+      if (cgroups[n].parent != g || cgroups[n].queued == 0) continue;
+      if (best < 0 || cgroups[n].vtime < cgroups[best].vtime) best = n;
+    }
+    if (g >= 0 && cgroup_own_queued(g) > 0 &&
+        (best < 0 || cgroups[g].own_vtime <= cgroups[best].vtime))
+      return g;
+    if (best < 0) return g;
+    g = best;
+  }
+}
+
+/* The levels are looked through in the order the policies dequeue them */
+extern pcb_t *cgroup_dequeue(ready_queue_t *rq, const sched_ops_t *policy) {
+  int g = cgroup_pick(), level;
+  pcb_t *pos, *prev;
+
+  for (level = 0; g >= 0 && level < SCHED_LEVELS; level++) {
+    prev = NULL;
+    for (pos = rq->level[level].head; pos != NULL;
+         prev = pos, pos = pos->next) {
+      if (cgroup_of[pos->pid] != g) continue;
+      pcb_list_remove(&rq->level[level], prev, pos);
+      cgroup_queued(pos, -1);
+      return pos;
+    }
+  }
+
+  pos = policy->dequeue(rq);
+  if (pos != NULL) cgroup_queued(pos, -1);
+  return pos;
+}
+
+extern unsigned int cgroup_tick(pcb_t **running, pcb_t **released,
+                                unsigned int *victims,
+                                unsigned int *victim_count) {
+  unsigned int now = getSimulatorTime(), cpu_count = sched_cpu_count(), n;
+  int g, throttle = 0, release = 0;
+
+  for (n = 0; n < cpu_count; n++) {
+    if (running[n] == NULL) continue;
+    g = cgroup_of[running[n]->pid];
+    cgroups[g].own_vtime += CGROUP_VTIME_SCALE / CGROUP_DEFAULT_SHARES;
+    for (; g >= 0; g = cgroups[g].parent) {
+      cgroups[g].vtime += CGROUP_VTIME_SCALE / cgroups[g].shares;
+      cgroups[g].usage++;
+      cgroups[g].used++;
+    }
+  }
+
+  for (n = 0; n <= cgroup_count; n++) {
+    if ((now + 1) % cgroups[n].period == 0) {
+      cgroups[n].used = 0;
+      release |= cgroups[n].throttled;
+      cgroups[n].throttled = 0;
+    } else if (cgroups[n].quota > 0 && !cgroups[n].throttled &&
+               cgroups[n].used >= cgroups[n].quota) {
+      cgroups[n].throttled = 1;
+      cgroups[n].throttles++;
+      throttle = 1;
+    }
+    if (cgroups[n].throttled) cgroups[n].throttled_ticks++;
+  }
+
+  *victim_count = 0;
+  if (throttle) {
+    cgroup_hold();
+    PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+    for (n = 0; n < cpu_count; n++)
+      if (current[n] != NULL && cgroup_throttled(current[n]))
+        victims[(*victim_count)++] = n;
+    pthread_mutex_unlock(&current_mutex);
+  }
+  return release ? cgroup_unhold(released) : 0;
+}
+
+extern void cgroup_terminated(pcb_t *proc, unsigned int ticks) {
+  cgroup_turnaround[proc->pid] = ticks;
+}
+
+extern unsigned int cgroup_save(pcb_t **ready) {
+  unsigned int count = 0, n;
+  pcb_t *proc;
+
+  for (n = 0; n <= cgroup_count; n++) {
+    for (proc = cgroups[n].held.head; proc != NULL; proc = proc->next)
+      ready[count++] = proc;
+  }
+  return count;
+}
+
+/*
+ * cgroup_hold moves the processes of throttled groups from the ready queues
+ * to their groups' held lists.  ready_mutex must be held
+ */
+static void cgroup_hold(void) {
+  pcb_t *pos, *prev, *next;
+  unsigned int d;
+  int level;
+
+  for (d = 0; d < domain_count; d++) {
+    for (level = 0; level < SCHED_LEVELS; level++) {
+      prev = NULL;
+      for (pos = ready_queue[d].level[level].head; pos != NULL; pos = next) {
+        next = pos->next;
+        if (!cgroup_throttled(pos)) {
+          prev = pos;
+          continue;
+        }
+        pcb_list_remove(&ready_queue[d].level[level], prev, pos);
+        ready_queue[d].count--;
+        ready_count--;
+        cgroup_queued(pos, -1);
+        pcb_list_append(&cgroups[cgroup_of[pos->pid]].held, pos);
+      }
+    }
+  }
+}
+
+/*
+ * cgroup_unhold takes the held processes of the groups no longer throttled
+ * off their lists into released[], and returns how many there were.
+ * ready_mutex must be held
+ */
+static unsigned int cgroup_unhold(pcb_t **released) {
+  unsigned int count = 0, n;
+  pcb_t *proc;
+
+  for (n = 0; n <= cgroup_count; n++) {
+    if (cgroups[n].held.head == NULL || cgroup_throttled(cgroups[n].held.head))
+      continue;
+    while ((proc = pcb_list_pop(&cgroups[n].held)) != NULL)
+      released[count++] = proc;
+  }
+  return count;
+}
+
+/*
+ * cgroup_report prints each group's usage and throttling, and the
+ * turnaround percentiles of the processes in it and the groups under it
+ */
+static void cgroup_report(void) {
+  static const unsigned int percentiles[] = {50, 90, 99};
+  unsigned int *ticks = malloc(sizeof(unsigned int) * process_count);
+  unsigned int g, n, count;
+  int up;
+
+  assert(ticks != NULL);
+  for (g = 0; g <= cgroup_count; g++) {
+    count = 0;
+    for (n = 0; n < process_count; n++) {
+      if (cgroup_turnaround[n] == CGROUP_NEVER) continue;
+      for (up = cgroup_of[n]; up >= 0 && up != (int)g; up = cgroups[up].parent)
+        ;
+      if (up == (int)g) ticks[count++] = cgroup_turnaround[n];
+    }
+    if (g == 0 && cgroups[0].usage == 0 && count == 0) continue;
+
+    printf("CPU group %s%s: used %.1f s, throttled %u times for %.1f s\n",
+           g == 0 ? "(other)" : cgroups[g].prefix, g == 0 ? "" : "*",
+           (float)cgroups[g].usage / 10.0, cgroups[g].throttles,
+           (float)cgroups[g].throttled_ticks / 10.0);
+    if (count == 0) continue;
+    sort_ticks(ticks, count);
+    printf("  turnaround of %u processes:", count);
+    for (n = 0; n < sizeof(percentiles) / sizeof(percentiles[0]); n++) {
+      printf(" p%u %.1f s,", percentiles[n],
+             (float)tick_percentile(ticks, count, percentiles[n]) / 10.0);
+    }
+    printf(" max %.1f s\n", (float)ticks[count - 1] / 10.0);
+  }
+  free(ticks);
+}
@@ -0,0 +1,145 @@
+/*
+ * cgroup.h
+ * Multithreaded OS Simulation
+ *
+ * CPU bandwidth groups (-C), after Linux's cgroups under CFS.  A process is
+ * in the group with the longest prefix of its name, or in the default group
+ * if no group matches it.  Of the groups with processes ready, the next
+ * process comes from the one that has had the least CPU time for its
+ * shares, going down from the top groups, and the policy orders the
+ * processes within a group.  A group that uses up its quota is throttled
+ * until its period ends: its running processes are preempted, and its
+ * ready ones held on its own list, off the ready queues.  The core calls
+ * cgroup_tick() from scheduler_tick() to do the accounting on the
+ * supervisor, every tick, with periods starting on tick 0.
+ *
+ * The core in student.c owns the ready queues, and queues, preempts and
+ * wakes; these functions keep the groups, and are called with ready_mutex
+ * held unless they say otherwise.
+ */
+
+#ifndef __CGROUP_H__
+#define __CGROUP_H__
+
+#include "os-sim.h"
+#include "sched.h"
+
+#define CGROUP_MAX 8
+#define CGROUP_DEFAULT_SHARES 1024
+
+/*
+ * A CPU bandwidth group (-C).  Groups nest by the prefixes of the process
+ * names they match, and ready_mutex protects them.
+ *
+ *   prefix : the start of the names of the group's processes.
+ *
+ *   parent : the group whose prefix is the longest to start this one's, or
+ *        -1 for a group at the top.
+ *
+ *   shares : the group's weight against its sibling groups.
+ *
+ *   quota, period : the CPU ticks the group may use in each period, or 0
+ *        for no limit, and the period's length in ticks.
+ *
+ *   used : the CPU ticks used so far this period.
+ *
+ *   throttled : set once used reaches quota, until the period ends.
+ *
+ *   queued : the processes of the group and the groups under it on the
+ *        policy's ready queues.
+ *
+ *   vtime, own_vtime : the CPU ticks the group has had, scaled down by its
+ *        shares, and those its own processes have had, as one entity of
+ *        CGROUP_DEFAULT_SHARES next to the groups under it.
+ *
+ *   held : the ready processes of the group kept off the ready queues while
+ *        it, or a group over it, is throttled.
+ *
+ *   usage, throttles, throttled_ticks : the CPU ticks the group has used,
+ *        the times it was throttled, and the ticks it spent throttled.
+ */
+typedef struct {
+  const char* prefix;
+  int parent;
+  unsigned int shares;
+  unsigned int quota;
+  unsigned int period;
+  unsigned int used;
+  int throttled;
+  unsigned int queued;
+  unsigned long long vtime;
+  unsigned long long own_vtime;
+  pcb_list_t held;
+  unsigned int usage;
+  unsigned int throttles;
+  unsigned int throttled_ticks;
+} cgroup_t;
+
+/* The number of groups added with -C, not counting the default group */
+extern unsigned int cgroup_count;
+
+/*
+ * cgroup_add() adds a group for -C, of the processes whose names start with
+ * prefix, with the given shares, and quota and period in ms.  There is room
+ * for CGROUP_MAX groups.  It is called without ready_mutex, before
+ * cgroup_init().
+ */
+extern void cgroup_add(const char *prefix, unsigned int shares,
+                       unsigned int quota_ms, unsigned int period_ms);
+
+/* cgroup_print() prints the groups added, without ready_mutex */
+extern void cgroup_print(void);
+
+/*
+ * cgroup_init() links each group to the one over it and each process to its
+ * group, has the supervisor call scheduler_tick(), and prints the groups'
+ * report at exit.  It returns -1 if two groups have the same prefix.  It is
+ * called without ready_mutex, once the processes are created.
+ */
+extern int cgroup_init(void);
+
+/*
+ * cgroup_held() puts a ready process on its group's held list if its group,
+ * or any group over it, is throttled, and returns whether it did.
+ */
+extern int cgroup_held(pcb_t *proc);
+
+/*
+ * cgroup_queued() counts a process onto (delta 1) or off (delta -1) the
+ * policy's ready queues, in its group and the groups over it.
+ */
+extern void cgroup_queued(pcb_t *proc, int delta);
+
+/*
+ * cgroup_dequeue() takes the first process, in the policy's order, of the
+ * group picked off a ready queue.  If the group has none on this queue, the
+ * policy picks instead.
+ */
+extern pcb_t *cgroup_dequeue(ready_queue_t *rq, const sched_ops_t *policy);
+
+/*
+ * cgroup_tick() charges the tick to the groups of the processes that ran,
+ * and throttles the groups that have used up their quota: their ready
+ * processes are held, and the CPUs running their processes are put in
+ * victims[], with *victim_count set to how many, for the core to preempt.
+ * A group whose period ends with this tick starts the next one with its
+ * quota back, and its held processes are taken off its list into
+ * released[], for the core to queue again.  It returns how many there are.
+ */
+extern unsigned int cgroup_tick(pcb_t **running, pcb_t **released,
+                                unsigned int *victims,
+                                unsigned int *victim_count);
+
+/*
+ * cgroup_terminated() records how long a process took to terminate, for
+ * the report.  It is called without ready_mutex.
+ */
+extern void cgroup_terminated(pcb_t *proc, unsigned int ticks);
+
+/*
+ * cgroup_save() copies the processes held off the ready queues into
+ * ready[], and returns how many there are.
+ */
+extern unsigned int cgroup_save(pcb_t **ready);
+
+#endif /* __CGROUP_H__ */
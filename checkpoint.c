@@ -0,0 +1,226 @@
+/*
+ * checkpoint.c
+ * Multithreaded OS Simulation
+ *
+ * Reading and writing checkpoint files.  See checkpoint.h for the format.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+/* Words before the per process state: magic, version and 20 scalars */
+#define CHECKPOINT_HEADER_WORDS 22
+
+extern checkpoint_t *checkpoint_alloc(unsigned int cpu_count,
+                                      unsigned int process_count,
+                                      unsigned int lock_count) {
+  checkpoint_t *c = calloc(1, sizeof(checkpoint_t));
+
+  assert(c != NULL);
+  c->cpu_count = cpu_count;
+  c->process_count = process_count;
+  c->lock_count = lock_count;
+  c->process = calloc(process_count, sizeof(checkpoint_process_t));
+  c->cpu = calloc(cpu_count, sizeof(checkpoint_cpu_t));
+  c->io = calloc(process_count, sizeof(checkpoint_io_t));
+  c->ready = calloc(process_count, sizeof(unsigned int));
+  c->lock = calloc(lock_count, sizeof(checkpoint_lock_t));
+  assert(c->process != NULL && c->cpu != NULL && c->io != NULL &&
+         c->ready != NULL && (c->lock != NULL || lock_count == 0));
+  return c;
+}
+
+extern void checkpoint_free(checkpoint_t *c) {
+  free(c->process);
+  free(c->cpu);
+  free(c->io);
+  free(c->ready);
+  free(c->lock);
+  free(c);
+}
+
+/*
+ * The file is written and read one word at a time through these, so that
+ * the layout doesn't depend on how the compiler pads the structs.
+ */
+static void put_word(FILE *f, unsigned int word) {
+  fwrite(&word, sizeof(word), 1, f);
+}
+
+static void put_float(FILE *f, float value) {
+  unsigned int word;
+
+  memcpy(&word, &value, sizeof(word));
+  put_word(f, word);
+}
+
+static int get_word(FILE *f, unsigned int *word) {
+  return fread(word, sizeof(*word), 1, f) == 1 ? 0 : -1;
+}
+
+static int get_float(FILE *f, float *value) {
+  unsigned int word;
+
+  if (get_word(f, &word) != 0) return -1;
+  memcpy(value, &word, sizeof(word));
+  return 0;
+}
+
+extern int checkpoint_write(const checkpoint_t *c, const char *path) {
+  FILE *f = fopen(path, "wb");
+  unsigned int n;
+
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  put_word(f, CHECKPOINT_MAGIC);
+  put_word(f, CHECKPOINT_VERSION);
+  put_word(f, c->cpu_count);
+  put_word(f, c->process_count);
+  put_word(f, c->lock_count);
+  put_word(f, c->lock_workload);
+  put_word(f, c->simulator_time);
+  put_word(f, c->next_tick);
+  put_word(f, c->processes_created);
+  put_word(f, c->processes_terminated);
+  put_word(f, c->ready_counter);
+  put_word(f, c->running_counter);
+  put_word(f, c->waiting_counter);
+  put_word(f, c->idle_ready_counter);
+  put_word(f, c->context_switches);
+  put_word(f, c->cache_migrations);
+  put_word(f, c->socket_migrations);
+  put_word(f, c->migration_penalty);
+  put_word(f, c->creat_expires);
+  put_word(f, c->io_expires);
+  put_word(f, c->io_count);
+  put_word(f, c->ready_count);
+
+  for (n = 0; n < c->process_count; n++) {
+    put_word(f, c->process[n].pc);
+    put_word(f, c->process[n].remaining);
+    put_word(f, c->process[n].priority);
+    put_float(f, c->process[n].time_added);
+    put_word(f, c->process[n].state);
+    put_word(f, (unsigned int)c->process[n].last_cpu);
+  }
+  for (n = 0; n < c->cpu_count; n++) {
+    put_word(f, (unsigned int)c->cpu[n].current);
+    put_word(f, c->cpu[n].preempting);
+    put_word(f, c->cpu[n].burst_end);
+    put_word(f, c->cpu[n].slice_end);
+    put_word(f, c->cpu[n].expires);
+    put_word(f, c->cpu[n].busy_ticks);
+    put_word(f, c->cpu[n].idle_ticks);
+    put_word(f, c->cpu[n].dispatches);
+    put_word(f, c->cpu[n].preemptions);
+    put_word(f, c->cpu[n].migrations);
+    put_word(f, c->cpu[n].ready_seen);
+  }
+  for (n = 0; n < c->io_count; n++) {
+    put_word(f, c->io[n].pid);
+    put_word(f, c->io[n].execution_time);
+  }
+  for (n = 0; n < c->ready_count; n++) put_word(f, c->ready[n]);
+  for (n = 0; n < c->lock_count; n++) {
+    put_word(f, c->lock[n].contentions);
+    put_word(f, c->lock[n].wait_ticks);
+    put_word(f, c->lock[n].stall_ticks);
+  }
+
+  if (ferror(f) || fclose(f) != 0) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
+
+extern checkpoint_t *checkpoint_read(const char *path) {
+  FILE *f = fopen(path, "rb");
+  checkpoint_t *c = NULL;
+  unsigned int word[CHECKPOINT_HEADER_WORDS], n, current, last_cpu;
+  int err = 0;
+
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+
+  for (n = 0; n < CHECKPOINT_HEADER_WORDS; n++) err |= get_word(f, &word[n]);
+  if (err || word[0] != CHECKPOINT_MAGIC || word[1] != CHECKPOINT_VERSION) {
+    fprintf(stderr, "%s: not a version %d checkpoint\n", path,
+            CHECKPOINT_VERSION);
+    fclose(f);
+    return NULL;
+  }
+
+  c = checkpoint_alloc(word[2], word[3], word[4]);
+  c->lock_workload = word[5];
+  c->simulator_time = word[6];
+  c->next_tick = word[7];
+  c->processes_created = word[8];
+  c->processes_terminated = word[9];
+  c->ready_counter = word[10];
+  c->running_counter = word[11];
+  c->waiting_counter = word[12];
+  c->idle_ready_counter = word[13];
+  c->context_switches = word[14];
+  c->cache_migrations = word[15];
+  c->socket_migrations = word[16];
+  c->migration_penalty = word[17];
+  c->creat_expires = word[18];
+  c->io_expires = word[19];
+  c->io_count = word[20];
+  c->ready_count = word[21];
+  if (c->io_count > c->process_count || c->ready_count > c->process_count)
+    err = -1;
+
+  for (n = 0; !err && n < c->process_count; n++) {
+    err |= get_word(f, &c->process[n].pc);
+    err |= get_word(f, &c->process[n].remaining);
+    err |= get_word(f, &c->process[n].priority);
+    err |= get_float(f, &c->process[n].time_added);
+    err |= get_word(f, &c->process[n].state);
+    err |= get_word(f, &last_cpu);
+    c->process[n].last_cpu = (int)last_cpu;
+  }
+  for (n = 0; !err && n < c->cpu_count; n++) {
+    err |= get_word(f, &current);
+    c->cpu[n].current = (int)current;
+    err |= get_word(f, &c->cpu[n].preempting);
+    err |= get_word(f, &c->cpu[n].burst_end);
+    err |= get_word(f, &c->cpu[n].slice_end);
+    err |= get_word(f, &c->cpu[n].expires);
+    err |= get_word(f, &c->cpu[n].busy_ticks);
+    err |= get_word(f, &c->cpu[n].idle_ticks);
+    err |= get_word(f, &c->cpu[n].dispatches);
+    err |= get_word(f, &c->cpu[n].preemptions);
+    err |= get_word(f, &c->cpu[n].migrations);
+    err |= get_word(f, &c->cpu[n].ready_seen);
+  }
+  for (n = 0; !err && n < c->io_count; n++) {
+    err |= get_word(f, &c->io[n].pid);
+    err |= get_word(f, &c->io[n].execution_time);
+  }
+  for (n = 0; !err && n < c->ready_count; n++)
+    err |= get_word(f, &c->ready[n]);
+  for (n = 0; !err && n < c->lock_count; n++) {
+    err |= get_word(f, &c->lock[n].contentions);
+    err |= get_word(f, &c->lock[n].wait_ticks);
+    err |= get_word(f, &c->lock[n].stall_ticks);
+  }
+
+  fclose(f);
+  if (err) {
+    fprintf(stderr, "%s: truncated or corrupt checkpoint\n", path);
+    checkpoint_free(c);
+    return NULL;
+  }
+  return c;
+}
@@ -0,0 +1,157 @@
+/*
+ * checkpoint.h
+ * Multithreaded OS Simulation
+ *
+ * Checkpoint and restore of the complete simulation state.
+ *
+ * A checkpoint is taken by the supervisor at the start of a tick, and holds
+ * everything needed to carry on from that tick: the simulator clock and
+ * counters, each process's position in its operations array and the time
+ * left of its current operation, what every CPU is running and when its
+ * timer fires, the I/O queue, the order of the ready queue, and the lock
+ * statistics.  Restoring
+ * it into a fresh simulator, with the same number of CPUs and the same
+ * workload, continues the run from that tick.
+ *
+ * The scheduler policy is not part of a checkpoint: a run can be warmed up
+ * once with "-c <tick> <file>", and then continued from the same point with
+ * any policy with "-l <file>".  The ready processes are handed to the new
+ * policy in the order they were queued.
+ *
+ * On disk a checkpoint is a sequence of 32-bit words in host byte order,
+ * starting with CHECKPOINT_MAGIC and CHECKPOINT_VERSION.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#define CHECKPOINT_MAGIC 0x4b43534fu /* "OSCK" */
+#define CHECKPOINT_VERSION 5
+
+/* Stored in place of the expiry of a timer that is not armed */
+#define CHECKPOINT_NEVER 0xffffffffu
+
+/*
+ * Per process state.
+ *
+ *   pc : the index of the current operation in the process's operations.
+ *
+ *   remaining : the time left of the current operation.
+ *
+ *   priority, time_added, state, last_cpu : the PCB fields of the same
+ *   names.
+ */
+typedef struct {
+  unsigned int pc;
+  unsigned int remaining;
+  unsigned int priority;
+  float time_added;
+  unsigned int state;
+  int last_cpu;
+} checkpoint_process_t;
+
+/*
+ * Per CPU state.
+ *
+ *   current : the pid of the running process, or -1 if the CPU is idle.
+ *
+ *   preempting, burst_end, slice_end : as in simulator_cpu_data_t.
+ *
+ *   expires : the CPU's deadline, or CHECKPOINT_NEVER.
+ *
+ *   busy_ticks ... ready_seen : the CPU's load balance stats, as in
+ *   cpu_stats_t.
+ */
+typedef struct {
+  int current;
+  unsigned int preempting;
+  unsigned int burst_end;
+  unsigned int slice_end;
+  unsigned int expires;
+  unsigned int busy_ticks;
+  unsigned int idle_ticks;
+  unsigned int dispatches;
+  unsigned int preemptions;
+  unsigned int migrations;
+  unsigned int ready_seen;
+} checkpoint_cpu_t;
+
+/* The statistics of a simulated lock, as in sim_lock_t */
+typedef struct {
+  unsigned int contentions;
+  unsigned int wait_ticks;
+  unsigned int stall_ticks;
+} checkpoint_lock_t;
+
+/* An I/O request, from the head of the I/O queue to the tail */
+typedef struct {
+  unsigned int pid;
+  unsigned int execution_time;
+} checkpoint_io_t;
+
+typedef struct {
+  unsigned int cpu_count;
+  unsigned int process_count;
+  unsigned int lock_count;
+  unsigned int lock_workload;
+
+  /* Simulator clock and counters */
+  unsigned int simulator_time;
+  unsigned int next_tick;
+  unsigned int processes_created;
+  unsigned int processes_terminated;
+  unsigned int ready_counter;
+  unsigned int running_counter;
+  unsigned int waiting_counter;
+  unsigned int idle_ready_counter;
+  unsigned int context_switches;
+  unsigned int cache_migrations;
+  unsigned int socket_migrations;
+  unsigned int migration_penalty;
+
+  /* When the next process is created and the head I/O request completes */
+  unsigned int creat_expires;
+  unsigned int io_expires;
+
+  unsigned int io_count;
+  unsigned int ready_count;
+
+  checkpoint_process_t *process; /* process_count entries */
+  checkpoint_cpu_t *cpu;         /* cpu_count entries */
+  checkpoint_io_t *io;           /* io_count entries */
+  unsigned int *ready;           /* pids of the ready_count ready processes */
+  checkpoint_lock_t *lock;       /* lock_count entries */
+} checkpoint_t;
+
+/*
+ * checkpoint_alloc() allocates a checkpoint with room for the given number
+ * of CPUs, processes and locks; checkpoint_free() frees one.
+ */
+extern checkpoint_t *checkpoint_alloc(unsigned int cpu_count,
+                                      unsigned int process_count,
+                                      unsigned int lock_count);
+extern void checkpoint_free(checkpoint_t *c);
+
+/*
+ * checkpoint_write() saves a checkpoint to a file and checkpoint_read()
+ * loads one.  They return -1 and NULL on error, after printing the reason
+ * to stderr.
+ */
+extern int checkpoint_write(const checkpoint_t *c, const char *path);
+extern checkpoint_t *checkpoint_read(const char *path);
+
+/*
+ * The two functions below are implemented in os-sim.c, and must be called
+ * before start_simulator().
+ *
+ * simulator_checkpoint_at() makes the simulator write a checkpoint to path
+ * at the start of the given tick, or the first tick after it at which no
+ * CPU is in the middle of a context switch, and then exit.
+ *
+ * simulator_restore_from() makes the simulator start from the checkpoint in
+ * path instead of tick 0.
+ */
+extern void simulator_checkpoint_at(unsigned int tick, const char *path);
+extern void simulator_restore_from(const char *path);
+
+#endif /* __CHECKPOINT_H__ */
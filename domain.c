@@ -0,0 +1,106 @@
+/*
+ * domain.c
+ * Multithreaded OS Simulation
+ *
+ * Scheduling domains for sockets and caches.  See domain.h for the
+ * interface.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "domain.h"
+#include "os-sim.h"
+#include "park.h"
+#include "prof.h"
+#include "student.h"
+
+static unsigned int domain_load(unsigned int domain, int self);
+
+topology_t topology = {1, 0, 0, 1, 4};
+unsigned int imbalance_pct = 125;
+
+static unsigned int domain_pulls = 0;
+
+extern unsigned int home_domain(pcb_t *proc) {
+  unsigned int d, load, best = 0, best_load = ~0u;
+
+  if (domain_count == 1) return 0;
+  if (proc->last_cpu >= 0) return cpu_socket(proc->last_cpu);
+  for (d = 0; d < domain_count; d++) {
+    load = domain_load(d, -1);
+    if (load < best_load) {
+      best = d;
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+extern int busiest_domain(unsigned int domain, int self) {
+  unsigned int d, load, local, best_load = 0;
+  int best = -1;
+
+  if (domain_count == 1) return -1;
+  local = domain_load(domain, self);
+  for (d = 0; d < domain_count; d++) {
+    if (d == domain || ready_queue[d].count == 0) continue;
+    load = domain_load(d, -1);
+    if (load * 100 > local * imbalance_pct && load > best_load) {
+      best = d;
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+extern unsigned int domain_remote(unsigned int domain) {
+  unsigned int remote = 0, d;
+
+  for (d = 0; domain_count > 1 && d < domain_count; d++) {
+    if (d != domain && busiest_domain(d, -1) == (int)domain)
+      remote |= 1u << d;
+  }
+  return remote;
+}
+
+extern void domain_pulled(void) { domain_pulls++; }
+
+extern void domain_report(void) {
+  printf("Processes pulled between sockets by idle CPUs: %u\n", domain_pulls);
+}
+
+extern void wake_domain(pcb_t *proc, unsigned int domain,
+                        unsigned int remote) {
+  unsigned int per_socket = topology.cores_per_socket;
+  unsigned int per_cache = topology.cores_per_cache;
+  int last_cpu = __atomic_load_n(&proc->last_cpu, __ATOMIC_RELAXED);
+  int cpu = -1;
+  unsigned int d;
+
+  /* the process may already be running again, and last_cpu changing */
+  if (last_cpu >= 0 && cpu_socket(last_cpu) == domain)
+    cpu = park_claim_range(cpu_cache(last_cpu) * per_cache, per_cache);
+  if (cpu < 0) cpu = park_claim_range(domain * per_socket, per_socket);
+  for (d = 0; cpu < 0 && d < domain_count; d++) {
+    if (remote & (1u << d))
+      cpu = park_claim_range(d * per_socket, per_socket);
+  }
+  if (cpu >= 0) park_wake(cpu);
+}
+
+/*
+ * domain_load returns the processes running on a socket, leaving out the
+ * CPU self which is choosing its next, plus those on its ready queue.
+ * ready_mutex must be held
+ */
+static unsigned int domain_load(unsigned int domain, int self) {
+  unsigned int load = ready_queue[domain].count, c;
+  unsigned int first = domain * topology.cores_per_socket;
+
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  for (c = first; c < first + topology.cores_per_socket; c++)
+    if (current[c] != NULL && (int)c != self) load++;
+  pthread_mutex_unlock(&current_mutex);
+  return load;
+}
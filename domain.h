@@ -0,0 +1,65 @@
+/*
+ * domain.h
+ * Multithreaded OS Simulation
+ *
+ * Scheduling domains (-n).  Each socket has a ready queue of its own, and
+ * a process is queued on the socket it last ran on, and woken on an idle
+ * CPU in the cache it last ran in if there is one.  A CPU with nothing on
+ * its own socket's queue pulls from the busiest other socket only when
+ * that socket's load, its running and ready processes, is more than
+ * imbalance_pct percent of its own, as Linux balances between its
+ * sched-domains.  The simulator charges the migration penalties.
+ *
+ * The core in student.c owns the ready queues; these functions only decide
+ * which of them to use, and are called with ready_mutex held unless they
+ * say otherwise.
+ */
+
+#ifndef __DOMAIN_H__
+#define __DOMAIN_H__
+
+#include "os-sim.h"
+
+/* The machine, set from -n and -M, and the imbalance set by -b */
+extern topology_t topology;
+extern unsigned int imbalance_pct;
+
+/*
+ * home_domain() returns the socket a process last ran on, or for a process
+ * that has not run yet, the least loaded socket.
+ */
+extern unsigned int home_domain(pcb_t *proc);
+
+/*
+ * busiest_domain() returns the socket a CPU of the given socket should pull
+ * a process from: the most loaded one with processes queued, if its load is
+ * over imbalance_pct percent of the given socket's, leaving out the CPU self
+ * which is choosing its next.  It returns -1 if the load is balanced.
+ */
+extern int busiest_domain(unsigned int domain, int self);
+
+/*
+ * domain_remote() returns the other sockets, as a bitmask, whose idle CPUs
+ * would pull a process queued on the given socket over.  The mask has room
+ * for DOMAIN_MAX_SOCKETS sockets.
+ */
+#define DOMAIN_MAX_SOCKETS 32
+
+extern unsigned int domain_remote(unsigned int domain);
+
+/*
+ * domain_pulled() counts a process pulled from another socket's queue, for
+ * the report at exit, which domain_report() prints.
+ */
+extern void domain_pulled(void);
+extern void domain_report(void);
+
+/*
+ * wake_domain() wakes an idle CPU for a process queued on a socket: in the
+ * cache the process last ran in, or elsewhere on the socket, or failing
+ * those on one of the remote sockets that would pull it over.  It is called
+ * without ready_mutex.
+ */
+extern void wake_domain(pcb_t *proc, unsigned int domain, unsigned int remote);
+
+#endif /* __DOMAIN_H__ */
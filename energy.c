@@ -0,0 +1,63 @@
+/*
+ * energy.c
+ * Multithreaded OS Simulation
+ *
+ * The race to idle and packing energy policies.  See energy.h for the
+ * interface.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "energy.h"
+#include "os-sim.h"
+#include "prof.h"
+#include "sched.h"
+#include "student.h"
+
+static void pack_report(void);
+
+energy_policy_t energy = ENERGY_OFF;
+
+static unsigned int pack_deferred = 0;
+
+extern void energy_init(void) {
+  printf("energy model, %s\n",
+         energy == ENERGY_RACE ? "racing to idle" : "packing the work");
+  simulator_energy_model();
+  if (energy == ENERGY_PACK) atexit(pack_report);
+}
+
+extern int pack_needs_cpu(void) {
+  unsigned int c, cpu_count = sched_cpu_count(), running = 0;
+  int awake = 0;
+
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  for (c = 0; c < cpu_count; c++) {
+    if (current[c] != NULL)
+      running++;
+    else if (!cpu_sleeping(c))
+      awake = 1;
+  }
+  pthread_mutex_unlock(&current_mutex);
+
+  if (awake || ready_count > running) return 1;
+  pack_deferred++;
+  return 0;
+}
+
+extern void pack_frequency(unsigned int cpu_id) {
+  unsigned int waiting;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  waiting = ready_count;
+  pthread_mutex_unlock(&ready_mutex);
+  set_cpu_frequency(cpu_id, waiting < CPU_FREQ_LEVELS - 1
+                               ? CPU_FREQ_LEVELS - 1 - waiting
+                               : 0);
+}
+
+static void pack_report(void) {
+  printf("Wake-ups held back by packing: %u\n", pack_deferred);
+}
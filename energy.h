@@ -0,0 +1,44 @@
+/*
+ * energy.h
+ * Multithreaded OS Simulation
+ *
+ * Energy policy (-E).  Racing to idle, every CPU runs at full speed and
+ * each process that becomes ready wakes an idle CPU, so the work gets done
+ * as soon as it can and the CPUs get back to sleep.  Packing, the work is
+ * kept on as few CPUs as it takes: a ready process is left to wait for a
+ * running CPU rather than wake a sleeping one, unless more processes are
+ * ready than CPUs are running, and a CPU runs at its slowest frequency
+ * unless processes are waiting behind the one it is switching to, one step
+ * faster for each.
+ */
+
+#ifndef __ENERGY_H__
+#define __ENERGY_H__
+
+typedef enum { ENERGY_OFF = 0, ENERGY_RACE, ENERGY_PACK } energy_policy_t;
+
+/* Set by -E */
+extern energy_policy_t energy;
+
+/*
+ * energy_init() turns on the simulator's energy model, and for packing the
+ * report at exit of the wake-ups held back.
+ */
+extern void energy_init(void);
+
+/*
+ * pack_needs_cpu() decides whether a process just queued should wake an
+ * idle CPU: yes if an idle CPU is still awake, or if more processes are
+ * ready than CPUs are running.  Otherwise it can wait for a running CPU
+ * rather than wake a sleeping one.  ready_mutex must be held.
+ */
+extern int pack_needs_cpu(void);
+
+/*
+ * pack_frequency() sets the frequency of a CPU switching to a process: its
+ * slowest when no process is waiting, and one level faster for each that
+ * is.
+ */
+extern void pack_frequency(unsigned int cpu_id);
+
+#endif /* __ENERGY_H__ */
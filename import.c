@@ -0,0 +1,384 @@
+/*
+ * import.c
+ * Multithreaded OS Simulation
+ *
+ * The importer of Linux scheduler traces.  See import.h for what it makes
+ * of them.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os-sim.h"
+#include "import.h"
+#include "process.h"
+#include "stream.h"
+
+/* Longer lines are skipped; a sched_switch line is under 300 characters */
+#define IMPORT_LINE_MAX 1024
+
+/* The kernel's TASK_COMM_LEN */
+#define IMPORT_COMM_LEN 16
+
+/* The pid hash table, twice the most tasks so it never fills */
+#define IMPORT_HASH_SIZE (2 * IMPORT_MAX_TASKS)
+
+typedef enum {
+  TASK_RUNNING,
+  TASK_RUNNABLE,
+  TASK_SLEEPING,
+  TASK_EXITED,
+  TASK_TRUNCATED
+} task_state_t;
+
+/*
+ * A task in the trace.
+ *
+ *   first_run : when it first ran, which orders the processes.
+ *
+ *   since : when it last started running, or went to sleep.
+ *
+ *   cpu : the seconds of CPU time in the burst so far.
+ *
+ *   ops : its operations, or when streaming, those not yet written to the
+ *        spill file, in a buffer of one chunk.  first and last are the
+ *        offsets of the first and last chunks written, or -1.
+ *
+ *   op_total : the operations it has had in all.
+ */
+typedef struct {
+  int pid;
+  char name[IMPORT_COMM_LEN];
+  unsigned int static_priority;
+  task_state_t state;
+  double first_run;
+  double since;
+  double cpu;
+  op_t *ops;
+  unsigned int op_count, op_size, op_total;
+  long first, last;
+} import_task_t;
+
+static import_task_t *tasks;
+static unsigned int task_count;
+static int *task_slot;
+static unsigned int chunk_ops;
+static double tick_seconds, trace_start = -1.0, trace_end = 0.0;
+static unsigned long events = 0, malformed = 0, over_limit = 0;
+
+static unsigned int to_ticks(double seconds) {
+  return (unsigned int)(seconds / tick_seconds + 0.5);
+}
+
+/* flush() writes out a streamed task's buffered operations as a chunk */
+static void flush(import_task_t *task) {
+  task->last = stream_write(task->ops, task->op_count, task->last);
+  if (task->first < 0) task->first = task->last;
+  task->op_count = 0;
+}
+
+static void emit(import_task_t *task, op_type type, unsigned int time) {
+  if (chunk_ops > 0 && task->op_count == chunk_ops) flush(task);
+  if (task->op_count == task->op_size) {
+    task->op_size = task->op_size ? task->op_size * 2 : 64;
+    if (task->op_size > IMPORT_MAX_OPS) task->op_size = IMPORT_MAX_OPS;
+    if (chunk_ops > 0) task->op_size = chunk_ops;
+    task->ops = realloc(task->ops, sizeof(op_t) * task->op_size);
+    assert(task->ops != NULL);
+  }
+  assert(task->op_count < task->op_size);
+  task->ops[task->op_count].type = type;
+  task->ops[task->op_count].time = time;
+  task->op_count++;
+  task->op_total++;
+}
+
+/*
+ * finish() ends the task with its last CPU burst.  When streaming, the
+ * last chunk is written and the buffer freed at once.
+ */
+static void finish(import_task_t *task, task_state_t state) {
+  unsigned int cpu = to_ticks(task->cpu);
+
+  emit(task, OP_CPU, cpu > 0 ? cpu : 1);
+  emit(task, OP_TERMINATE, 0);
+  task->state = state;
+  if (chunk_ops > 0) {
+    flush(task);
+    free(task->ops);
+    task->ops = NULL;
+  }
+}
+
+/*
+ * find() returns the task with the given pid, or makes one if create is
+ * set, or returns NULL.  A task that exited is replaced, as its pid has
+ * been reused.
+ */
+static import_task_t *find(int pid, const char *comm, size_t comm_len,
+                           int prio, int create) {
+  unsigned int slot = (unsigned int)pid * 2654435761u % IMPORT_HASH_SIZE;
+  import_task_t *task;
+
+  while (task_slot[slot] >= 0 && tasks[task_slot[slot]].pid != pid)
+    slot = (slot + 1) % IMPORT_HASH_SIZE;
+  if (task_slot[slot] >= 0 &&
+      (tasks[task_slot[slot]].state != TASK_EXITED || !create))
+    return &tasks[task_slot[slot]];
+  if (!create) return NULL;
+  if (task_count == IMPORT_MAX_TASKS) {
+    over_limit++;
+    return NULL;
+  }
+
+  task_slot[slot] = task_count;
+  task = &tasks[task_count++];
+  task->pid = pid;
+  if (comm_len >= IMPORT_COMM_LEN) comm_len = IMPORT_COMM_LEN - 1;
+  memcpy(task->name, comm, comm_len);
+  task->name[comm_len] = '\0';
+  task->static_priority = prio < 139 ? 140 - prio : 1;
+  task->state = TASK_RUNNING;
+  task->cpu = 0.0;
+  task->first = task->last = -1;
+  return task;
+}
+
+/*
+ * wake() ends a sleep at time t, as an I/O request after the CPU burst
+ * before it, unless it was too short to count
+ */
+static void wake(import_task_t *task, double t) {
+  unsigned int io = to_ticks(t - task->since), cpu = to_ticks(task->cpu);
+
+  if (task->state != TASK_SLEEPING) return;
+  task->state = TASK_RUNNABLE;
+  if (io == 0) return;
+
+  // room for this burst and request, and the last burst and OP_TERMINATE
+  if (chunk_ops == 0 && task->op_count + 4 > IMPORT_MAX_OPS) {
+    finish(task, TASK_TRUNCATED);
+    return;
+  }
+  emit(task, OP_CPU, cpu > 0 ? cpu : 1);
+  emit(task, OP_IO, io);
+  task->cpu = 0.0;
+}
+
+static void switch_in(import_task_t *task, double t, int created) {
+  if (created) task->first_run = t;
+  wake(task, t);
+  if (task->state == TASK_TRUNCATED) return;
+  task->state = TASK_RUNNING;
+  task->since = t;
+}
+
+static void switch_out(import_task_t *task, double t, char state,
+                       int created) {
+  // a task first seen leaving a CPU was running when the trace began
+  if (created) {
+    task->first_run = trace_start;
+    task->since = trace_start;
+  }
+  if (task->state != TASK_RUNNING) return;
+  task->cpu += t - task->since;
+
+  if (state == 'R') {
+    task->state = TASK_RUNNABLE;
+  } else if (state == 'X' || state == 'Z') {
+    finish(task, TASK_EXITED);
+  } else {
+    task->state = TASK_SLEEPING;
+    task->since = t;
+  }
+}
+
+/*
+ * field() returns where the value of key starts in text, and sets end to
+ * where it ends: at the given terminator, or else at the next space
+ */
+static char *field(char *text, const char *key, const char *terminator,
+                   char **end) {
+  char *value = strstr(text, key);
+
+  if (value == NULL) return NULL;
+  value += strlen(key);
+  *end = terminator != NULL ? strstr(value, terminator) : NULL;
+  if (*end == NULL) *end = value + strcspn(value, " \n");
+  return value;
+}
+
+/*
+ * timestamp() reads the time before the event name, "1234.567890:",
+ * which perf script writes before "sched:sched_switch:"
+ */
+static int timestamp(char *line, char *event, double *t) {
+  char *p = event;
+
+  if (p - line >= 6 && strncmp(p - 6, "sched:", 6) == 0) p -= 6;
+  while (p > line && p[-1] == ' ') p--;
+  if (p == line || p[-1] != ':') return -1;
+  p--;
+  while (p > line && ((p[-1] >= '0' && p[-1] <= '9') || p[-1] == '.')) p--;
+  *t = strtod(p, NULL);
+  return 0;
+}
+
+/* parse() applies one line of the trace, returning -1 if it is malformed */
+static int parse(char *line) {
+  char *event, *comm, *comm_end, *pid, *prio, *state, *end;
+  import_task_t *task;
+  int created;
+  double t;
+
+  if ((event = strstr(line, "sched_switch:")) == NULL &&
+      (event = strstr(line, "sched_wakeup:")) == NULL &&
+      (event = strstr(line, "sched_wakeup_new:")) == NULL)
+    return 0;
+  if (timestamp(line, event, &t) != 0) return -1;
+  if (trace_start < 0.0) trace_start = t;
+
+  // per-CPU buffers can be merged slightly out of order
+  if (t < trace_end) t = trace_end;
+  trace_end = t;
+  events++;
+
+  if (event[6] == 's') {
+    if ((comm = field(event, "prev_comm=", " prev_pid=", &comm_end)) == NULL ||
+        (pid = field(comm_end, "prev_pid=", NULL, &end)) == NULL ||
+        (prio = field(end, "prev_prio=", NULL, &end)) == NULL ||
+        (state = field(end, "prev_state=", NULL, &end)) == NULL)
+      return -1;
+    if (atoi(pid) != 0) {
+      created = task_count;
+      task = find(atoi(pid), comm, comm_end - comm, atoi(prio), 1);
+      if (task != NULL)
+        switch_out(task, t, *state, task == &tasks[created]);
+    }
+
+    if ((comm = field(end, "next_comm=", " next_pid=", &comm_end)) == NULL ||
+        (pid = field(comm_end, "next_pid=", NULL, &end)) == NULL ||
+        (prio = field(end, "next_prio=", NULL, &end)) == NULL)
+      return -1;
+    if (atoi(pid) != 0) {
+      created = task_count;
+      task = find(atoi(pid), comm, comm_end - comm, atoi(prio), 1);
+      if (task != NULL) switch_in(task, t, task == &tasks[created]);
+    }
+  } else {
+    // a task not yet run starts with its first CPU burst, not a wakeup
+    if ((pid = field(event, " pid=", NULL, &end)) == NULL) return -1;
+    task = find(atoi(pid), NULL, 0, 0, 0);
+    if (task != NULL) wake(task, t);
+  }
+  return 0;
+}
+
+static int compare_first_run(const void *a, const void *b) {
+  const import_task_t *x = *(import_task_t *const *)a;
+  const import_task_t *y = *(import_task_t *const *)b;
+
+  if (x->first_run != y->first_run) return x->first_run < y->first_run ? -1 : 1;
+  return x < y ? -1 : x > y;
+}
+
+extern int import_processes(const char *path, unsigned int usec_per_tick,
+                            unsigned int stream_chunk_ops) {
+  char line[IMPORT_LINE_MAX];
+  import_task_t **order;
+  unsigned long lines = 0, ops = 0;
+  unsigned int n;
+  size_t len;
+  FILE *f;
+  int c;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  tick_seconds = usec_per_tick / 1e6;
+  chunk_ops = stream_chunk_ops;
+  if (chunk_ops > 0 && stream_create(chunk_ops) != 0) {
+    fclose(f);
+    return -1;
+  }
+  tasks = calloc(IMPORT_MAX_TASKS, sizeof(import_task_t));
+  task_slot = malloc(sizeof(int) * IMPORT_HASH_SIZE);
+  assert(tasks != NULL && task_slot != NULL);
+  for (n = 0; n < IMPORT_HASH_SIZE; n++) task_slot[n] = -1;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lines++;
+    len = strlen(line);
+    if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+      while ((c = getc(f)) != EOF && c != '\n')
+        ;
+      malformed++;
+      continue;
+    }
+    if (parse(line) != 0) malformed++;
+  }
+  if (ferror(f)) {
+    perror(path);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  // the tasks still alive terminate at the end of the trace
+  for (n = 0; n < task_count; n++) {
+    if (tasks[n].state == TASK_EXITED || tasks[n].state == TASK_TRUNCATED)
+      continue;
+    if (tasks[n].state == TASK_RUNNING)
+      tasks[n].cpu += trace_end - tasks[n].since;
+    if (tasks[n].state == TASK_SLEEPING) tasks[n].state = TASK_RUNNABLE;
+    finish(&tasks[n], TASK_EXITED);
+  }
+  free(task_slot);
+  if (task_count == 0) {
+    fprintf(stderr, "%s: no sched_switch events\n", path);
+    return -1;
+  }
+
+  order = malloc(sizeof(import_task_t *) * task_count);
+  assert(order != NULL);
+  for (n = 0; n < task_count; n++) order[n] = &tasks[n];
+  qsort(order, task_count, sizeof(import_task_t *), compare_first_run);
+
+  process_count = task_count;
+  group_count = 0;
+  lock_workload = 0;
+  processes = malloc(sizeof(pcb_t) * process_count);
+  process_ops = malloc(sizeof(const op_t *) * process_count);
+  assert(processes != NULL && process_ops != NULL);
+  for (n = 0; n < process_count; n++) {
+    pcb_t pcb = {n,           order[n]->name, order[n]->static_priority,
+                 0,           0,              0,
+                 PROCESS_NEW, order[n]->ops,  0,
+                 -1,          NULL};
+
+    process_ops[n] = order[n]->ops;
+    ops += order[n]->op_total;
+
+    /* pcb_t has const members, so copy it in rather than assigning it */
+    memcpy(&processes[n], &pcb, sizeof(pcb_t));
+    if (chunk_ops > 0)
+      stream_attach(&processes[n], order[n]->first);
+    else
+      processes[n].remaining = order[n]->ops->time;
+  }
+  free(order);
+
+  printf("imported %u tasks, %lu operations, from %lu events over %.3f s "
+         "in %s\n",
+         process_count, ops, events, trace_end - trace_start, path);
+  if (malformed > 0)
+    printf("  skipped %lu malformed lines of %lu\n", malformed, lines);
+  if (over_limit > 0)
+    printf("  skipped %lu events of tasks over the limit of %d\n", over_limit,
+           IMPORT_MAX_TASKS);
+  return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * import.h
+ * Multithreaded OS Simulation
+ *
+ * Builds the process table from a trace of a real Linux machine.
+ *
+ * The trace is the text of the sched_switch and sched_wakeup events, as
+ * written by ftrace (/sys/kernel/tracing/trace, or trace-cmd report) or by
+ * perf script after perf sched record.  Each task in the trace becomes a
+ * process whose operations alternate between the CPU time it got between
+ * going to sleep, and the time it slept until it was woken:
+ *
+ *   - A task is switched out still runnable (prev_state R) when preempted,
+ *     so its CPU burst goes on the next time it runs.
+ *   - It goes to sleep when switched out in any other state, and the sleep
+ *     is an I/O request that lasts until its sched_wakeup, or until it next
+ *     runs if the wakeup was not traced.  A sleep shorter than half a tick
+ *     is dropped, and the CPU bursts either side of it are joined.
+ *   - It terminates when switched out dead (X or Z), or at the end of the
+ *     trace.  A pid seen again after it died is a new task.
+ *
+ * The time the task spent waiting for a CPU is left out, as that is up to
+ * the scheduler.  The processes are created in the order the tasks first
+ * ran, named after the tasks' comm, and a task's static_priority is 140
+ * less its kernel priority, so higher is more important as in sched_prio.
+ * The idle tasks (pid 0) are ignored.
+ *
+ * The trace is read a line at a time, and the memory used is bounded by
+ * IMPORT_MAX_TASKS tasks of at most IMPORT_MAX_OPS operations, however
+ * many events it holds.  Tasks over the limit are skipped, and a task that
+ * runs out of operations terminates there.  When streaming (see stream.h)
+ * there is no limit on a task's operations, as they go to disk.
+ */
+
+#ifndef __IMPORT_H__
+#define __IMPORT_H__
+
+#define IMPORT_MAX_TASKS 4096
+#define IMPORT_MAX_OPS 8192
+
+/*
+ * import_processes() builds the process table from the trace in the file
+ * at path, each tick of the simulation standing for usec_per_tick
+ * microseconds of the trace.  If stream_chunk_ops is not 0 the operations
+ * are streamed from disk in chunks of that many.  It returns 0, or -1 after
+ * printing the reason to stderr.  It is called in place of
+ * create_processes().
+ */
+extern int import_processes(const char *path, unsigned int usec_per_tick,
+                            unsigned int stream_chunk_ops);
+
+#endif /* __IMPORT_H__ */
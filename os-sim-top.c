@@ -0,0 +1,88 @@
+/*
+ * os-sim-top.c
+ * Multithreaded OS Simulation
+ *
+ * Watches a running simulator through its live stats page (see stats.h):
+ *
+ *   ./os-sim 4 -r 4 -w 100 -q -S /os-sim &
+ *   ./os-sim-top /os-sim
+ *
+ * Every interval it takes a consistent copy of the page and shows the
+ * counters, with the rates and CPU utilisation over the interval as well
+ * as over the whole run.  It never blocks the simulator, and exits once
+ * the run has finished.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define TOP_INTERVAL_MS 1000
+
+static const char *state_name[PROCESS_STATES] = {"new", "ready", "running",
+                                                  "waiting", "terminated"};
+
+static double percent(unsigned int part, unsigned int whole) {
+  return whole != 0 ? 100.0 * part / whole : 0.0;
+}
+
+static void show(const char *name, const stats_page_t *now,
+                 const stats_page_t *then) {
+  unsigned int ticks = now->tick - then->tick, n;
+
+  if (isatty(STDOUT_FILENO)) printf("\033[H\033[J");
+  printf("%s: tick %u (%.1f s)%s\n", name, now->tick, now->tick / 10.0,
+         now->finished ? ", finished" : "");
+  printf("processes: %u created, %u terminated\n", now->processes_created,
+         now->processes_terminated);
+  printf("states:");
+  for (n = 0; n < PROCESS_STATES; n++)
+    printf(" %u %s", now->state_count[n], state_name[n]);
+  printf("\ncontext switches: %u, %u in the last %u ticks\n",
+         now->context_switches, now->context_switches - then->context_switches,
+         ticks);
+  printf("ready queue levels:");
+  for (n = 0; n < SCHED_LEVELS; n++) printf(" %u", now->ready_level[n]);
+  printf("\nI/O queue: %u\n\n", now->io_queue_length);
+
+  printf("CPU  running  interval  total\n");
+  for (n = 0; n < now->cpu_count && n < STATS_MAX_CPUS; n++) {
+    if (now->cpu_current[n] == STATS_IDLE)
+      printf("%-4u %-8s", n, "(IDLE)");
+    else
+      printf("%-4u %-8u", n, now->cpu_current[n]);
+    printf(" %6.1f%%  %5.1f%%\n",
+           percent(now->cpu_busy[n] - then->cpu_busy[n], ticks),
+           percent(now->cpu_busy[n], now->tick));
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  const stats_page_t *page;
+  stats_page_t now, then;
+  struct timespec interval;
+  long ms = TOP_INTERVAL_MS;
+
+  if (argc < 2 || argc > 3 || (argc == 3 && (ms = atol(argv[2])) <= 0)) {
+    fprintf(stderr, "Usage: ./os-sim-top <shared memory name> [ <interval "
+                    "in ms> ]\n");
+    return -1;
+  }
+  page = stats_attach(argv[1]);
+  if (page == NULL) return -1;
+
+  interval.tv_sec = ms / 1000;
+  interval.tv_nsec = ms % 1000 * 1000000;
+  stats_read(page, &then);
+  do {
+    nanosleep(&interval, NULL);
+    stats_read(page, &now);
+    show(argv[1], &now, &then);
+    then = now;
+  } while (!now.finished);
+  return 0;
+}
@@ -3,22 +3,29 @@
  * Multithreaded OS Simulation - original file from project 4 at
  * http://www.cc.gatech.edu/~rama/CS2200-External
  *
- * The simulator internals.
+ * The simulator: its CPU and supervisor threads, ticks, I/O, locks and stats.
  *
  * Last modified 2/23/2014 by Sherri Goings
- *
- * DO NOT MODIFY THIS FILE
  */
 
 #include <assert.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "checkpoint.h"
 #include "os-sim.h"
 #include "process.h"
+#include "prof.h"
+#include "replay.h"
+#include "stats.h"
+#include "stream.h"
 #include "student.h"
+#include "tick.h"
+#include "timer.h"
+#include "trace.h"
 
 typedef enum {
   CPU_IDLE = 0,
@@ -28,30 +35,171 @@ typedef enum {
   CPU_TERMINATE
 } simulator_cpu_state_t;
 
+/*
+ * Rather than counting the running process down every tick, each CPU has a
+ * deadline in cpu_deadline[] for its next event: either the end of the
+ * current CPU burst (burst_end) or, if it comes first, the expiry of the
+ * time slice (slice_end), in which case preempting is set.  See tick.h.
+ *
+ * freq_level is the frequency the current process runs at, and run_start
+ * the tick it starts running on, once the CPU has woken up.  idle_ticks
+ * counts the ticks the CPU has been idle, and asleep is set once it is in
+ * deep sleep.  batched is set while the CPU is being preempted by
+ * force_preempt_batch(), until its context switch.
+ */
 typedef struct {
   pcb_t *current;
   simulator_cpu_state_t state;
   pthread_cond_t wakeup;
-  int preemption_timer;
+  int preempting;
+  unsigned int burst_end;
+  unsigned int slice_end;
+  unsigned int freq_level;
+  unsigned int run_start;
+  unsigned int idle_ticks;
+  int asleep;
+  int batched;
 } simulator_cpu_data_t;
 
-/* The I/O queue is a simple, FIFO queue using a linked list */
+/*
+ * The load balance of a CPU, for the final stats: the ticks it spent
+ * running a process and idle, the processes it dispatched and had
+ * preempted, those of them that last ran on another CPU, and the sum over
+ * its dispatches of the processes left READY.
+ */
+typedef struct {
+  unsigned int busy_ticks;
+  unsigned int idle_ticks;
+  unsigned int dispatches;
+  unsigned int preemptions;
+  unsigned int migrations;
+  unsigned int ready_seen;
+} cpu_stats_t;
+
+/*
+ * The I/O queue is a simple, FIFO queue using a linked list.  Only the
+ * request at the head of the queue is in progress and has its timer armed.
+ */
 typedef struct _io_request {
   pcb_t *pcb;
   unsigned int execution_time;
+  sim_timer_t timer;
   struct _io_request *next;
 } io_request;
 
+/*
+ * A simulated lock.  The processes blocked on it wait in FIFO order, on a
+ * list chained through lock_next[] by pid.  A blocked process's pc stays on
+ * its OP_LOCK, so that the locks can be rebuilt after a restore from where
+ * the processes are in their operations.
+ *
+ *   contentions : how many times a process found the lock held.
+ *
+ *   wait_ticks, stall_ticks : the process-ticks spent blocked on the lock,
+ *        and those of them when the holder was not running either.
+ */
+typedef struct {
+  pcb_t *holder;
+  pcb_t *head, *tail;
+  unsigned int waiters;
+  unsigned int contentions;
+  unsigned int wait_ticks;
+  unsigned int stall_ticks;
+} sim_lock_t;
+
+/* A lock released to a waiter, to be woken up at the end of the tick */
+typedef struct {
+  pcb_t *holder;
+  pcb_t *waiter;
+} lock_grant_t;
+
 static io_request *io_queue_head = NULL, *io_queue_tail = NULL;
+static unsigned int io_queue_length = 0;
 static simulator_cpu_data_t *simulator_cpu_data;
+static unsigned int *cpu_deadline;
+static unsigned long long *cpu_due;
 static pthread_t *cpu_thread;
 static pthread_mutex_t simulator_mutex;
 static pthread_cond_t thread_yielded;
+static pthread_cond_t batch_yielded;
 static unsigned int simulator_time = 0;
+static unsigned int next_tick = 0;
+static timer_wheel_t timer_wheel;
+static sim_timer_t creat_timer;
+static unsigned int processes_created = 0;
 static unsigned int processes_terminated = 0;
 static unsigned int cpu_count;
 static unsigned int ready_counter = 0, running_counter = 0, waiting_counter = 0;
+static unsigned int idle_ready_counter = 0;
+static unsigned int state_count[PROCESS_STATES];
 static unsigned int context_switches = 0;
+static topology_t topology;
+static unsigned int cache_migrations = 0, socket_migrations = 0;
+static unsigned int migration_penalty = 0;
+static cpu_stats_t *cpu_stats;
+static sim_lock_t *locks;
+static pcb_t **lock_next;
+static int *blocked_on;
+static lock_grant_t *lock_grants;
+static unsigned int lock_grant_count = 0;
+static pcb_t **wake_batch;
+static unsigned int wake_batch_count = 0;
+static const char *checkpoint_path = NULL, *restore_path = NULL;
+static unsigned int checkpoint_tick;
+
+/*
+ * The open system (see simulator_open_loop()).  The gaps between arrivals
+ * are exponentially distributed, so arrivals are a Poisson process with
+ * arrival_rate per tick.  next_arrival is the time of the next one, in
+ * fractional ticks; it arrives on the tick it falls in.  job_count is how
+ * many processes arrive, which is all of them in a closed run.
+ */
+static int open_loop = 0;
+static double arrival_rate, next_arrival = 0.0;
+static unsigned long long arrival_seed;
+static unsigned int job_count, run_duration = 0;
+static unsigned int *arrival_tick, *finish_tick;
+
+/*
+ * The power model, per CPU.  A running CPU draws 1 W of static power plus
+ * 9 W of dynamic power at full speed, which scales with the cube of the
+ * frequency as the voltage comes down with it.  An idle CPU draws 1 W in
+ * its shallow idle state, and 0.1 W once it has been idle for
+ * DEEP_IDLE_TICKS and gone into deep sleep, from which it takes
+ * CPU_WAKE_TICKS to wake up.  A waking CPU draws full power.
+ *
+ * cpu_freq_request[] holds the level set_cpu_frequency() last set for each
+ * CPU, and is latched into freq_level by context_switch().
+ */
+#define DEEP_IDLE_TICKS 2
+#define CPU_WAKE_TICKS 1
+#define SHALLOW_IDLE_WATTS 1.0
+#define DEEP_IDLE_WATTS 0.1
+
+const unsigned int cpu_freq_pct[CPU_FREQ_LEVELS] = {100, 75, 50};
+static const double cpu_active_watts[CPU_FREQ_LEVELS] = {10.0, 4.8, 2.1};
+
+static int energy_model = 0;
+static unsigned int *cpu_freq_request;
+static double energy_joules = 0.0;
+static unsigned int busy_ticks[CPU_FREQ_LEVELS];
+static unsigned int shallow_ticks = 0, deep_ticks = 0, waking_ticks = 0;
+static unsigned int cpu_wakeups = 0;
+
+/*
+ * The live stats page (see stats.h), or NULL when none was asked for, and
+ * whether the Gantt chart is printed.
+ */
+static const char *stats_name = NULL;
+static stats_page_t *stats_page = NULL;
+static int gantt_enabled = 1;
+
+/*
+ * Whether scheduler_tick() is called (see simulator_scheduler_tick()), and
+ * the process each CPU ran during the tick, taken with the Gantt chart.
+ */
+static int tick_hook = 0;
+static pcb_t **tick_running;
 
 static void simulator_supervisor_thread(void);
 static void simulator_cpu_thread(unsigned int cpu_id);
@@ -61,12 +209,37 @@ int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
 static void print_gantt_header(void);
 static void print_gantt_line(void);
 static void print_final_stats(void);
-
+static void print_load_balance(void);
+static void publish_stats(int finished);
+static void finish_stats(void);
+static void count_process_states(void);
+static void account_energy(void);
+static void print_energy(void);
+
+static void migrate_process(unsigned int cpu_id, pcb_t *pcb,
+                            int preemption_time);
+static void wake_cpu(unsigned int cpu_id);
+static void arm_cpu_timer(unsigned int cpu_id, int preemption_time);
+static void set_cpu_deadline(unsigned int cpu_id, unsigned int start);
+static unsigned int burst_ticks(unsigned int cpu_id, unsigned int work);
+static void save_cpu_burst(unsigned int cpu_id);
 static void simulate_cpus(void);
+static void preempt_process(unsigned int cpu_id);
+static const op_t *next_op(pcb_t *pcb);
 static void simulate_process(unsigned int cpu_id, pcb_t *pcb);
 static void submit_io_request(pcb_t *pcb, unsigned int execution_time);
 static void simulate_io(void);
 static void simulate_creat(void);
+static double arrival_gap(void);
+static int compare_ticks(const void *a, const void *b);
+static void print_response_times(void);
+static int acquire_lock(pcb_t *pcb, unsigned int lock);
+static void release_lock(pcb_t *pcb, unsigned int lock);
+static void simulate_locks(void);
+static void deliver_wakeups(void);
+static void rebuild_locks(void);
+static void take_checkpoint(void);
+static void restore_checkpoint(void);
 
 static void *simulator_cpu_thread_func(void *data);
 
@@ -98,58 +271,159 @@ typedef struct {
   pthread_cond_init(&(i).no_writers, NULL); \
   (i).writers = 0;
 
-#define IRWL_READER_LOCK(i)                         \
-  pthread_mutex_lock(&(i).mutex);                   \
-  while ((i).writers > 0) {                         \
-    pthread_cond_wait(&(i).no_writers, &(i).mutex); \
+#define IRWL_READER_LOCK(i)                           \
+  {                                                   \
+    PROF_WAIT_START();                                \
+    REPLAY_MUTEX_LOCK(&(i).mutex, PROF_IRWL_READER);  \
+    while ((i).writers > 0) {                         \
+      PROF_WAITED();                                  \
+      REPLAY_COND_WAIT(&(i).no_writers, &(i).mutex,   \
+                       PROF_IRWL_READER);             \
+    }                                                 \
+    PROF_WAIT_END(PROF_IRWL_READER);                  \
   }
 
 #define IRWL_READER_UNLOCK(i) pthread_mutex_unlock(&(i).mutex);
 
-#define IRWL_WRITER_LOCK(i)       \
-  pthread_mutex_lock(&(i).mutex); \
-  (i).writers++;                  \
+#define IRWL_WRITER_LOCK(i)                      \
+  PROF_MUTEX_LOCK(&(i).mutex, PROF_IRWL_WRITER); \
+  (i).writers++;                                 \
   pthread_mutex_unlock(&(i).mutex);
 
-#define IRWL_WRITER_UNLOCK(i)             \
-  pthread_mutex_lock(&(i).mutex);         \
-  (i).writers--;                          \
-  if ((i).writers == 0) {                 \
-    pthread_cond_signal(&(i).no_writers); \
-  }                                       \
+#define IRWL_WRITER_UNLOCK(i)                       \
+  REPLAY_MUTEX_LOCK(&(i).mutex, PROF_IRWL_WRITER); \
+  (i).writers--;                                   \
+  if ((i).writers == 0) {                          \
+    REPLAY_COND_SIGNAL(&(i).no_writers);           \
+  }                                                \
   pthread_mutex_unlock(&(i).mutex);
 
 static irwl student_lock;
 
 /* The big initialization function */
-extern void start_simulator(unsigned int new_cpu_count) {
+extern void start_simulator(unsigned int new_cpu_count,
+                            const topology_t *new_topology) {
+  unsigned int max_cpus;
   int n;
 
-  /* Make sure the # of CPUs is reasonable */
+  /* Make sure the # of CPUs is reasonable: the Gantt chart has a column
+   * for each, so only without it can there be more than 16 */
   cpu_count = new_cpu_count;
-  if (cpu_count < 1 || cpu_count > 16) {
-    fprintf(stderr, "CPU Count must be an integer from 1 to 16!\n\n");
+  max_cpus = gantt_enabled ? 16 : SIMULATOR_MAX_CPUS;
+  if (cpu_count < 1 || cpu_count > max_cpus) {
+    fprintf(stderr, "CPU Count must be an integer from 1 to 16, or to %d "
+                    "without the Gantt chart!\n\n",
+            SIMULATOR_MAX_CPUS);
+    exit(-1);
+  }
+
+  /* Without a topology, the CPUs are one socket sharing one cache */
+  if (new_topology != NULL) {
+    topology = *new_topology;
+  } else {
+    topology.sockets = 1;
+    topology.cores_per_socket = cpu_count;
+    topology.cores_per_cache = cpu_count;
+    topology.cache_penalty = 0;
+    topology.socket_penalty = 0;
+  }
+  if (topology.sockets * topology.cores_per_socket != cpu_count ||
+      topology.cores_per_cache == 0 ||
+      topology.cores_per_socket % topology.cores_per_cache != 0) {
+    fprintf(stderr,
+            "%u sockets of %u CPUs, with %u CPUs to a cache, is not %u "
+            "CPUs!\n\n",
+            topology.sockets, topology.cores_per_socket,
+            topology.cores_per_cache, cpu_count);
     exit(-1);
   }
 
+  /* Build the default workload unless a larger one was asked for */
+  if (processes == NULL) create_processes(1, 0);
+  count_process_states();
+
   /* Allocate arrays */
   cpu_thread = malloc(sizeof(pthread_t) * cpu_count);
   assert(cpu_thread != NULL);
   simulator_cpu_data = malloc(sizeof(simulator_cpu_data_t) * cpu_count);
   assert(simulator_cpu_data != NULL);
+  cpu_deadline = malloc(sizeof(unsigned int) * cpu_count);
+  assert(cpu_deadline != NULL);
+  cpu_due = malloc(sizeof(unsigned long long) * TICK_MASK_WORDS(cpu_count));
+  assert(cpu_due != NULL);
+  cpu_freq_request = calloc(cpu_count, sizeof(unsigned int));
+  assert(cpu_freq_request != NULL);
+  tick_running = calloc(cpu_count, sizeof(pcb_t *));
+  assert(tick_running != NULL);
+  cpu_stats = calloc(cpu_count, sizeof(cpu_stats_t));
+  assert(cpu_stats != NULL);
+  locks = calloc(lock_count, sizeof(sim_lock_t));
+  lock_next = calloc(process_count, sizeof(pcb_t *));
+  blocked_on = malloc(sizeof(int) * process_count);
+  lock_grants = malloc(sizeof(lock_grant_t) * process_count);
+  wake_batch = malloc(sizeof(pcb_t *) * process_count);
+  assert(locks != NULL && lock_next != NULL && blocked_on != NULL &&
+         lock_grants != NULL && wake_batch != NULL);
+  for (n = 0; n < process_count; n++) blocked_on[n] = -1;
+  arrival_tick = malloc(sizeof(unsigned int) * process_count);
+  finish_tick = malloc(sizeof(unsigned int) * process_count);
+  assert(arrival_tick != NULL && finish_tick != NULL);
+  for (n = 0; n < process_count; n++) finish_tick[n] = TICK_NEVER;
+
+  if (!open_loop || job_count > process_count) job_count = process_count;
+  if (open_loop && (checkpoint_path != NULL || restore_path != NULL)) {
+    fprintf(stderr, "An open system can't be checkpointed or restored!\n\n");
+    exit(-1);
+  }
+  if (stream_enabled && (checkpoint_path != NULL || restore_path != NULL)) {
+    fprintf(stderr, "A streamed workload can't be checkpointed or "
+                    "restored!\n\n");
+    exit(-1);
+  }
+  if (energy_model && (checkpoint_path != NULL || restore_path != NULL)) {
+    fprintf(stderr, "The energy model can't be checkpointed or restored!\n\n");
+    exit(-1);
+  }
+  if (stats_name != NULL) {
+    stats_page = stats_create(stats_name, cpu_count);
+    if (stats_page == NULL) exit(-1);
+    atexit(finish_stats);
+  }
 
   /* Initialize mutexes and condition variables */
   pthread_mutex_init(&simulator_mutex, NULL);
   pthread_cond_init(&thread_yielded, NULL);
+  pthread_cond_init(&batch_yielded, NULL);
   simulator_time = 0;
+  next_tick = 0;
+  timer_wheel_init(&timer_wheel, simulator_time);
   for (n = 0; n < cpu_count; n++) {
     simulator_cpu_data[n].current = NULL;
     simulator_cpu_data[n].state = CPU_IDLE;
-    simulator_cpu_data[n].preemption_timer = -1;
+    simulator_cpu_data[n].preempting = 0;
+    simulator_cpu_data[n].burst_end = 0;
+    simulator_cpu_data[n].slice_end = TICK_NEVER;
+    simulator_cpu_data[n].freq_level = 0;
+    simulator_cpu_data[n].run_start = 0;
+    simulator_cpu_data[n].idle_ticks = 0;
+    simulator_cpu_data[n].asleep = 0;
+    simulator_cpu_data[n].batched = 0;
+    cpu_deadline[n] = TICK_NEVER;
     pthread_cond_init(&simulator_cpu_data[n].wakeup, NULL);
   }
 
+  /* The first process is created on tick 0 */
+  timer_init(&creat_timer, TIMER_CREAT, 0);
+  if (restore_path != NULL)
+    restore_checkpoint();
+  else
+    timer_add(&timer_wheel, &creat_timer, simulator_time);
+
   IRWL_INIT(student_lock)
+  prof_init();
+
+  /* When recording or replaying, the supervisor has the first turn */
+  replay_join(cpu_count);
 
   /* Start CPU threads */
   for (n = 0; n < cpu_count; n++)
@@ -162,7 +436,13 @@ extern void start_simulator(unsigned int new_cpu_count) {
 
 /*
  * This is the loop for the supervisor thread.  It waits for 100ms, then
- * simulates one interval of time.
+ * simulates one interval of time.  Advancing the timer wheel collects the
+ * I/O and creation events due on this tick.  simulate_cpus() handles the
+ * CPUs whose deadlines have come, and then simulate_locks(), simulate_io()
+ * and simulate_creat() collect the processes woken on this tick, in that
+ * order: those the CPUs released locks to, the one whose I/O completed,
+ * and the new ones.  deliver_wakeups() hands them all to the student's
+ * code at once, and ends the tick with scheduler_tick() if it is on.
  */
 static void simulator_supervisor_thread(void) {
   print_gantt_header();
@@ -170,19 +450,29 @@ static void simulator_supervisor_thread(void) {
   /* Loop, performing execution every 100ms.  At each execution, we will
      display a line in the Gantt chart and check for pending I/O requests */
   while (1) {
-    pthread_mutex_lock(&simulator_mutex);
+    PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
 
-    /* Exit when all processes terminate */
-    if (processes_terminated >= PROCESS_COUNT) {
+    /* Exit when all processes terminate, or the run's time is up */
+    if (processes_terminated >= job_count ||
+        (run_duration != 0 && simulator_time >= run_duration)) {
       print_final_stats();
       exit(0);
     }
 
+    /* Stop once the checkpoint asked for has been written */
+    if (checkpoint_path != NULL && simulator_time >= checkpoint_tick)
+      take_checkpoint();
+
     print_gantt_line();
+    timer_wheel_advance(&timer_wheel, simulator_time);
     simulate_cpus();
+    simulate_locks();
     simulate_io();
     simulate_creat();
-    simulator_time++;
+    deliver_wakeups();
+    if (trace_enabled) trace_drain();
+    /* The student's code reads the time on the CPU threads, unlocked */
+    __atomic_store_n(&simulator_time, simulator_time + 1, __ATOMIC_RELAXED);
     pthread_mutex_unlock(&simulator_mutex);
 
     mt_safe_usleep(1);
@@ -216,19 +506,24 @@ static void simulator_supervisor_thread(void) {
 static void simulator_cpu_thread(unsigned int cpu_id) {
   simulator_cpu_state_t state;
 
+  replay_join(cpu_id);
   while (1) {
-    pthread_mutex_lock(&simulator_mutex);
+    PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
     if (simulator_cpu_data[cpu_id].current == NULL) {
       /* the idle process was selected */
       simulator_cpu_data[cpu_id].state = CPU_IDLE;
     } else {
-      /* a process was scheduled */
-      simulator_cpu_data[cpu_id].state = CPU_RUNNING;
-
+      /*
+       * a process was scheduled; context_switch() already set CPU_RUNNING,
+       * and the supervisor may have posted this process's first event
+       * before we got back here, so don't overwrite it
+       */
       while (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
-        pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup, &simulator_mutex);
+        REPLAY_COND_WAIT(&simulator_cpu_data[cpu_id].wakeup, &simulator_mutex,
+                         PROF_SIMULATOR_MUTEX);
     }
     state = simulator_cpu_data[cpu_id].state;
+    if (state == CPU_TERMINATE) processes_terminated++;
     pthread_mutex_unlock(&simulator_mutex);
 
     /* Call student's code */
@@ -238,25 +533,24 @@ static void simulator_cpu_thread(unsigned int cpu_id) {
          * We can't lock the student_lock for idle(); otherwise we can't
          * print statistics while any CPU is idling.
          */
-        idle(cpu_id);
+        PROF_CALL(PROF_IDLE, idle(cpu_id));
         break;
 
       case CPU_PREEMPT:
         IRWL_WRITER_LOCK(student_lock)
-        preempt(cpu_id);
+        PROF_CALL(PROF_PREEMPT, preempt(cpu_id));
         IRWL_WRITER_UNLOCK(student_lock)
         break;
 
       case CPU_YIELD:
         IRWL_WRITER_LOCK(student_lock)
-        yield(cpu_id);
+        PROF_CALL(PROF_YIELD, yield(cpu_id));
         IRWL_WRITER_UNLOCK(student_lock)
         break;
 
       case CPU_TERMINATE:
-        processes_terminated++;
         IRWL_WRITER_LOCK(student_lock)
-        terminate(cpu_id);
+        PROF_CALL(PROF_TERMINATE, terminate(cpu_id));
         IRWL_WRITER_UNLOCK(student_lock)
         break;
 
@@ -274,6 +568,7 @@ static void simulator_cpu_thread(unsigned int cpu_id) {
 static void print_gantt_header(void) {
   int n;
 
+  if (!gantt_enabled) return;
   printf("Time  Ru Re Wa     ");
   for (n = 0; n < cpu_count; n++) printf(" CPU %d   ", n);
   printf(
@@ -285,35 +580,47 @@ static void print_gantt_header(void) {
 
 static void print_gantt_line(void) {
   io_request *r;
-  unsigned int current_ready = 0, current_running = 0, current_waiting = 0;
+  unsigned int current_ready, current_running, current_waiting, idle = 0;
   int n;
 
   /*
    * Update number of processes in each state.
    */
   IRWL_READER_LOCK(student_lock)
-  for (n = 0; n < PROCESS_COUNT; n++) {
-    switch (processes[n].state) {
-      case PROCESS_READY:
-        current_ready++;
-        ready_counter++;
-        break;
-
-      case PROCESS_RUNNING:
-        current_running++;
-        running_counter++;
-        break;
-
-      case PROCESS_WAITING:
-        current_waiting++;
-        waiting_counter++;
-        break;
+  current_ready =
+      __atomic_load_n(&state_count[PROCESS_READY], __ATOMIC_RELAXED);
+  current_running =
+      __atomic_load_n(&state_count[PROCESS_RUNNING], __ATOMIC_RELAXED);
+  current_waiting =
+      __atomic_load_n(&state_count[PROCESS_WAITING], __ATOMIC_RELAXED);
+
+  /* Count the time blocked on locks, and stalled behind idle holders */
+  for (n = 0; n < lock_count; n++) {
+    locks[n].wait_ticks += locks[n].waiters;
+    if (locks[n].waiters > 0 &&
+        __atomic_load_n(&locks[n].holder->state, __ATOMIC_RELAXED) !=
+            PROCESS_RUNNING)
+      locks[n].stall_ticks += locks[n].waiters;
+  }
+  IRWL_READER_UNLOCK(student_lock)
+  ready_counter += current_ready;
+  running_counter += current_running;
+  waiting_counter += current_waiting;
 
-      default:
-        break;
+  /* Count the ready processes that an idle CPU could have been running */
+  for (n = 0; n < cpu_count; n++) {
+    if (simulator_cpu_data[n].current == NULL) {
+      idle++;
+      cpu_stats[n].idle_ticks++;
+    } else {
+      cpu_stats[n].busy_ticks++;
     }
+    tick_running[n] = simulator_cpu_data[n].current;
   }
-  IRWL_READER_UNLOCK(student_lock)
+  idle_ready_counter += current_ready < idle ? current_ready : idle;
+  account_energy();
+  if (stats_page != NULL) publish_stats(0);
+  if (!gantt_enabled) return;
 
   /* Print time */
   printf("%-5.1f %-2d %-2d %-2d     ", (float)simulator_time / 10.0,
@@ -338,39 +645,292 @@ static void print_gantt_line(void) {
 }
 
 static void print_final_stats(void) {
+  unsigned int n;
+
   printf("\n\n");
   printf("# of Context Switches: %u\n", context_switches);
   printf("Total execution time: %.1f s\n", (float)simulator_time / 10.0);
   printf("Total time spent in READY state: %.1f s\n",
          (float)ready_counter / 10.0);
+  printf("Total time spent in READY state with a CPU idle: %.1f s\n",
+         (float)idle_ready_counter / 10.0);
+  if (topology.cores_per_cache < cpu_count)
+    printf("Migrations: %u across caches, %u across sockets, %.1f s of "
+           "penalty\n",
+           cache_migrations, socket_migrations,
+           (float)migration_penalty / 10.0);
+  if (cpu_count > 1) print_load_balance();
+  for (n = 0; lock_workload && n < lock_count; n++)
+    printf("Lock %s: %u contentions, %.1f s blocked, %.1f s of it with the "
+           "holder not running\n",
+           lock_names[n], locks[n].contentions,
+           (float)locks[n].wait_ticks / 10.0,
+           (float)locks[n].stall_ticks / 10.0);
+  if (open_loop) print_response_times();
+  if (energy_model) print_energy();
+}
+
+/*
+ * Prints each CPU's load, and how evenly the work was spread: the
+ * imbalance coefficient is the coefficient of variation of the CPUs' busy
+ * time, 0 when every CPU was busy for as long.
+ */
+static void print_load_balance(void) {
+  cpu_stats_t *s;
+  unsigned int n, migrations = 0, busiest = 0;
+  double mean = 0.0, variance = 0.0;
+
+  printf("CPU  busy s  idle s  dispatches  preempted  migrated in  avg ready"
+         "\n");
+  for (n = 0; n < cpu_count; n++) {
+    s = &cpu_stats[n];
+    printf("%-4u %6.1f  %6.1f  %10u  %9u  %11u  %9.2f\n", n,
+           (float)s->busy_ticks / 10.0, (float)s->idle_ticks / 10.0,
+           s->dispatches, s->preemptions, s->migrations,
+           s->dispatches ? (double)s->ready_seen / s->dispatches : 0.0);
+    mean += s->busy_ticks;
+    migrations += s->migrations;
+    if (s->busy_ticks > busiest) busiest = s->busy_ticks;
+  }
+  mean /= cpu_count;
+  for (n = 0; n < cpu_count; n++)
+    variance += (cpu_stats[n].busy_ticks - mean) *
+                (cpu_stats[n].busy_ticks - mean) / cpu_count;
+  printf("Load imbalance: coefficient %.3f, busiest CPU at %.2fx the mean; "
+         "%u migrations between CPUs\n",
+         mean > 0.0 ? sqrt(variance) / mean : 0.0,
+         mean > 0.0 ? busiest / mean : 0.0, migrations);
+}
+
+/*
+ * Copies the counters into the stats page, once a tick, and a last time
+ * when the simulator exits.  Like the Gantt chart, it is called with the
+ * simulator_mutex held, or by the supervisor on its way out.
+ */
+static void publish_stats(int finished) {
+  unsigned int n;
+
+  stats_begin(stats_page);
+  stats_page->finished = finished;
+  stats_page->tick = simulator_time;
+  stats_page->processes_created = processes_created;
+  stats_page->processes_terminated = processes_terminated;
+  stats_page->context_switches = context_switches;
+  stats_page->io_queue_length = io_queue_length;
+  for (n = 0; n < PROCESS_STATES; n++)
+    stats_page->state_count[n] =
+        __atomic_load_n(&state_count[n], __ATOMIC_RELAXED);
+  ready_queue_levels(stats_page->ready_level);
+  for (n = 0; n < cpu_count && n < STATS_MAX_CPUS; n++) {
+    if (simulator_cpu_data[n].current != NULL) {
+      stats_page->cpu_current[n] = simulator_cpu_data[n].current->pid;
+      if (!finished) stats_page->cpu_busy[n]++;
+    } else {
+      stats_page->cpu_current[n] = STATS_IDLE;
+    }
+  }
+  stats_end(stats_page);
 }
 
+/* Tells the readers the run is over, however the simulator exits */
+static void finish_stats(void) { publish_stats(1); }
+
 /*
- * context_switch() and force_preempt() are the two functions available to
- * student's code.
+ * Charges each CPU's power for this tick, and puts the CPUs that have been
+ * idle long enough into deep sleep.
+ */
+static void account_energy(void) {
+  simulator_cpu_data_t *cpu;
+  unsigned int n;
+  double watts = 0.0;
+
+  for (n = 0; n < cpu_count; n++) {
+    cpu = &simulator_cpu_data[n];
+    if (cpu->current != NULL) {
+      if (simulator_time < cpu->run_start) {
+        waking_ticks++;
+        watts += cpu_active_watts[0];
+      } else {
+        busy_ticks[cpu->freq_level]++;
+        watts += cpu_active_watts[cpu->freq_level];
+      }
+      continue;
+    }
+
+    if (cpu->idle_ticks < DEEP_IDLE_TICKS) cpu->idle_ticks++;
+    if (cpu->idle_ticks >= DEEP_IDLE_TICKS && energy_model)
+      __atomic_store_n(&cpu->asleep, 1, __ATOMIC_RELAXED);
+    if (cpu->asleep) {
+      deep_ticks++;
+      watts += DEEP_IDLE_WATTS;
+    } else {
+      shallow_ticks++;
+      watts += SHALLOW_IDLE_WATTS;
+    }
+  }
+  energy_joules += watts * 0.1;
+}
+
+/*
+ * Prints the energy the CPUs used, per job completed, and how the CPU time
+ * was spent between the frequencies and the idle states.
+ */
+static void print_energy(void) {
+  unsigned int n;
+
+  printf("Energy: %.1f J, %.1f J per completed job, %.1f W on average\n",
+         energy_joules,
+         processes_terminated > 0 ? energy_joules / processes_terminated : 0.0,
+         simulator_time > 0 ? energy_joules * 10.0 / simulator_time : 0.0);
+  printf("CPU time:");
+  for (n = 0; n < CPU_FREQ_LEVELS; n++)
+    printf(" %.1f s at %u%%,", (float)busy_ticks[n] / 10.0, cpu_freq_pct[n]);
+  printf(" %.1f s idle, %.1f s asleep, %.1f s waking up (%u wake-ups)\n",
+         (float)shallow_ticks / 10.0, (float)deep_ticks / 10.0,
+         (float)waking_ticks / 10.0, cpu_wakeups);
+}
+
+/*
+ * Prints the throughput of an open system, and the percentiles of the
+ * response times of the processes that terminated, from the tick they
+ * arrived on to the tick they terminated on.  A percentile is the smallest
+ * response time that at least that share of the processes finished within.
+ */
+static void print_response_times(void) {
+  static const unsigned int percentiles[] = {50, 90, 95, 99};
+  unsigned int *response = malloc(sizeof(unsigned int) * process_count);
+  unsigned int n, done = 0;
+  double total = 0.0;
+
+  assert(response != NULL);
+  for (n = 0; n < processes_created; n++) {
+    if (finish_tick[n] == TICK_NEVER) continue;
+    response[done] = finish_tick[n] - arrival_tick[n];
+    total += response[done];
+    done++;
+  }
+
+  printf("Open system: %u arrived at %.2f per second, %u completed, "
+         "throughput %.3f per second\n",
+         processes_created, arrival_rate * 10.0, done,
+         simulator_time > 0 ? done * 10.0 / simulator_time : 0.0);
+  if (done == 0) {
+    free(response);
+    return;
+  }
+
+  sort_ticks(response, done);
+  printf("Response time: mean %.1f s", total / done / 10.0);
+  for (n = 0; n < sizeof(percentiles) / sizeof(percentiles[0]); n++) {
+    printf(", p%u %.1f s", percentiles[n],
+           (float)tick_percentile(response, done, percentiles[n]) / 10.0);
+  }
+  printf(", max %.1f s\n", (float)response[done - 1] / 10.0);
+  free(response);
+}
+
+static int compare_ticks(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+extern void sort_ticks(unsigned int *ticks, unsigned int count) {
+  qsort(ticks, count, sizeof(unsigned int), compare_ticks);
+}
+
+extern unsigned int tick_percentile(const unsigned int *ticks,
+                                    unsigned int count, unsigned int pct) {
+  return ticks[(count * pct + 99) / 100 - 1];
+}
+
+/*
+ * Counts the processes in each state from scratch.  After this the counts
+ * are kept up to date by set_process_state().
+ */
+static void count_process_states(void) {
+  int n;
+
+  for (n = 0; n < PROCESS_STATES; n++) state_count[n] = 0;
+  for (n = 0; n < process_count; n++) state_count[processes[n].state]++;
+}
+
+/*
+ * context_switch(), force_preempt() and set_process_state() are the
+ * functions available to student's code.
  */
 extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
                            int preemption_time) {
   assert(cpu_id < cpu_count);
   assert(pcb == NULL ||
-         (pcb >= processes && pcb <= processes + PROCESS_COUNT - 1));
-
-  context_switches++;
+         (pcb >= processes && pcb <= processes + process_count - 1));
 
   IRWL_WRITER_UNLOCK(student_lock);
-  pthread_mutex_lock(&simulator_mutex);
+  PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
+  context_switches++;
   simulator_cpu_data[cpu_id].current = pcb;
-  simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
-  pthread_cond_signal(&thread_yielded);
+  if (pcb != NULL) {
+    cpu_stats[cpu_id].dispatches++;
+    cpu_stats[cpu_id].ready_seen +=
+        __atomic_load_n(&state_count[PROCESS_READY], __ATOMIC_RELAXED);
+    simulator_cpu_data[cpu_id].state = CPU_RUNNING;
+    migrate_process(cpu_id, pcb, preemption_time);
+    wake_cpu(cpu_id);
+  } else {
+    simulator_cpu_data[cpu_id].idle_ticks = 0;
+  }
+  arm_cpu_timer(cpu_id, preemption_time);
+  if (simulator_cpu_data[cpu_id].batched) {
+    simulator_cpu_data[cpu_id].batched = 0;
+    REPLAY_COND_BROADCAST(&batch_yielded);
+  } else {
+    REPLAY_COND_SIGNAL(&thread_yielded);
+  }
   pthread_mutex_unlock(&simulator_mutex);
   IRWL_WRITER_LOCK(student_lock);
 }
 
+/*
+ * Processes change state on the CPU threads and on the supervisor, mostly
+ * but not always under the student_lock writer side, so the counts and the
+ * state itself are updated atomically.
+ */
+extern void set_process_state(pcb_t *pcb, process_state_t state) {
+  if (pcb->state == state) return;
+
+  __atomic_fetch_sub(&state_count[pcb->state], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&state_count[state], 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&pcb->state, state, __ATOMIC_RELAXED);
+}
+
+extern pcb_t *lock_blocker(pcb_t *pcb) {
+  return blocked_on[pcb->pid] >= 0 ? locks[blocked_on[pcb->pid]].holder
+                                   : NULL;
+}
+
+extern void simulator_energy_model(void) { energy_model = 1; }
+
+extern void simulator_publish_stats(const char *name) { stats_name = name; }
+
+extern void simulator_quiet(void) { gantt_enabled = 0; }
+
+extern void simulator_scheduler_tick(void) { tick_hook = 1; }
+
+extern void set_cpu_frequency(unsigned int cpu_id, unsigned int level) {
+  assert(cpu_id < cpu_count && level < CPU_FREQ_LEVELS);
+  __atomic_store_n(&cpu_freq_request[cpu_id], level, __ATOMIC_RELAXED);
+}
+
+extern int cpu_sleeping(unsigned int cpu_id) {
+  assert(cpu_id < cpu_count);
+  return __atomic_load_n(&simulator_cpu_data[cpu_id].asleep, __ATOMIC_RELAXED);
+}
+
 extern void force_preempt(unsigned int cpu_id) {
   assert(cpu_id < cpu_count);
 
   IRWL_WRITER_UNLOCK(student_lock);
-  pthread_mutex_lock(&simulator_mutex);
+  PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
 
   /*
    * It is possible that the student's code calls force_preempt() at the
@@ -378,106 +938,445 @@ extern void force_preempt(unsigned int cpu_id) {
    * check for that case by only preempting if the CPU is set to CPU_RUNNING.
    */
   if (simulator_cpu_data[cpu_id].state == CPU_RUNNING) {
+    save_cpu_burst(cpu_id);
+    cpu_stats[cpu_id].preemptions++;
     simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-    pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+    REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_id].wakeup);
     // wait to make sure thread finishes preempt and context switch
-    pthread_cond_wait(&thread_yielded, &simulator_mutex);
+    REPLAY_COND_WAIT(&thread_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
   }
 
   pthread_mutex_unlock(&simulator_mutex);
   IRWL_WRITER_LOCK(student_lock);
 }
 
+/*
+ * All the victims are told to preempt before waiting for any of them, so
+ * they switch in parallel.  Their context switches wake the caller on
+ * batch_yielded rather than thread_yielded, so a batch never takes the
+ * wake-up of a force_preempt() on another thread, and waits until none of
+ * its own victims is left.
+ */
+extern void force_preempt_batch(const int *cpu_ids, unsigned int count) {
+  unsigned int n, left;
+
+  IRWL_WRITER_UNLOCK(student_lock);
+  PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
+
+  for (n = 0; n < count; n++) {
+    if (cpu_ids[n] < 0) continue;
+    assert((unsigned int)cpu_ids[n] < cpu_count);
+    if (simulator_cpu_data[cpu_ids[n]].state != CPU_RUNNING) continue;
+    save_cpu_burst(cpu_ids[n]);
+    cpu_stats[cpu_ids[n]].preemptions++;
+    simulator_cpu_data[cpu_ids[n]].state = CPU_PREEMPT;
+    simulator_cpu_data[cpu_ids[n]].batched = 1;
+    REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_ids[n]].wakeup);
+  }
+
+  do {
+    for (n = 0, left = 0; n < count; n++)
+      if (cpu_ids[n] >= 0 && simulator_cpu_data[cpu_ids[n]].batched) left++;
+    if (left > 0)
+      REPLAY_COND_WAIT(&batch_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
+  } while (left > 0);
+
+  pthread_mutex_unlock(&simulator_mutex);
+  IRWL_WRITER_LOCK(student_lock);
+}
+
 /*
  * The functions below are used by the supervisor thread to simulate the OS.
  *
- * simulate_cpus() / simulate_process() simulate the processes on each CPU
- *   and signal the appropriate CPU thread if an event occurs.
+ * arm_cpu_timer() / save_cpu_burst() set and clear the deadline of the
+ *   process running on a CPU.
+ *
+ * simulate_cpus() / simulate_process() handle the CPUs whose deadlines came
+ *   this tick and signal the appropriate CPU thread; preempt_process()
+ *   signals a preemption.
  *
  * submit_io_request() inserts a PCB into tail of the I/O queue.
  *
- * simulate_io() simulates the I/O request at the head of the I/O queue and
- *   calls wake_up() upon completion.
+ * simulate_io() completes the I/O request at the head of the I/O queue when
+ *   its timer expires, and adds the process to the tick's wake-ups.
+ *
+ * simulate_creat() simulates initial process creation by adding the new
+ *   process to the tick's wake-ups.
  *
- * simulate_creat() simulates initial process creation by calling the
- *   student's wake_up().
+ * deliver_wakeups() calls the student's wake_up_batch() for the tick's
+ *   wake-ups.
  */
 
-static void simulate_cpus(void) {
-  int n;
+extern unsigned int cpu_socket(unsigned int cpu_id) {
+  return cpu_id / topology.cores_per_socket;
+}
 
-  for (n = 0; n < cpu_count; n++) {
-    if (simulator_cpu_data[n].current != NULL) {
-      simulate_process(n, simulator_cpu_data[n].current);
+extern unsigned int cpu_cache(unsigned int cpu_id) {
+  return cpu_id / topology.cores_per_cache;
+}
+
+/*
+ * Charges a process switched in on a CPU away from the cache it last ran
+ * in.  The penalty is added to what is left of its CPU burst, so the
+ * process holds the CPU that much longer to do the same work.  It is at
+ * most half the time slice, so that a process moved on every switch still
+ * gets some work done.
+ */
+static void migrate_process(unsigned int cpu_id, pcb_t *pcb,
+                            int preemption_time) {
+  unsigned int penalty = 0;
+
+  if (pcb->last_cpu >= 0 && pcb->last_cpu != (int)cpu_id)
+    cpu_stats[cpu_id].migrations++;
+  if (pcb->last_cpu >= 0 && pcb->pc->type == OP_CPU) {
+    if (cpu_socket(pcb->last_cpu) != cpu_socket(cpu_id)) {
+      socket_migrations++;
+      penalty = topology.socket_penalty;
+    } else if (cpu_cache(pcb->last_cpu) != cpu_cache(cpu_id)) {
+      cache_migrations++;
+      penalty = topology.cache_penalty;
+    }
+  }
+  if (preemption_time > 0 && penalty > preemption_time / 2)
+    penalty = preemption_time / 2;
+  pcb->remaining += penalty;
+  migration_penalty += penalty;
+  __atomic_store_n(&pcb->last_cpu, (int)cpu_id, __ATOMIC_RELAXED);
+}
+
+/*
+ * Sets the frequency a process just switched onto a CPU runs at, and the
+ * tick it starts on: next_tick, or if the CPU was asleep, once it is awake.
+ */
+static void wake_cpu(unsigned int cpu_id) {
+  simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+
+  cpu->freq_level =
+      __atomic_load_n(&cpu_freq_request[cpu_id], __ATOMIC_RELAXED);
+  cpu->run_start = next_tick;
+  cpu->idle_ticks = 0;
+  if (cpu->asleep) {
+    cpu->run_start += CPU_WAKE_TICKS;
+    cpu_wakeups++;
+    __atomic_store_n(&cpu->asleep, 0, __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * Sets the deadline of a CPU for the process just switched onto it.  The
+ * process first runs on run_start and consumes one unit of its CPU burst
+ * per tick at full speed.  The burst completes the tick after its last unit
+ * has run; a time slice that runs out first preempts the process on the
+ * tick its last unit runs, which is when the old per-tick countdown
+ * reached zero.
+ */
+static void arm_cpu_timer(unsigned int cpu_id, int preemption_time) {
+  simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+  const op_t *pc;
+
+  cpu_deadline[cpu_id] = TICK_NEVER;
+  cpu->preempting = 0;
+  if (cpu->current == NULL) return;
+
+  pc = cpu->current->pc;
+  switch (pc->type) {
+    case OP_CPU:
+      break;
+
+    case OP_IO:
+      /* Scheduling a process that's blocked on I/O */
+      printf("Scheduled a process that's blocked on I/0! PID: %s\n",
+             cpu->current->name);
+      return;
+
+    case OP_TERMINATE:
+      /* Scheduling a process that's terminated */
+      printf("Scheduled a terminated process! PID: %s\n", cpu->current->name);
+      return;
+
+    case OP_LOCK:
+    case OP_UNLOCK:
+      /* Scheduling a process that's blocked on a lock */
+      printf("Scheduled a process that's blocked on a lock! PID: %s\n",
+             cpu->current->name);
+      return;
+  }
+
+  cpu->slice_end = preemption_time > 0
+                       ? cpu->run_start + preemption_time - 1
+                       : TICK_NEVER;
+  set_cpu_deadline(cpu_id, cpu->run_start);
+}
+
+/*
+ * Sets the deadline of a CPU from the burst its process starts on the given
+ * tick, and the time slice it has left.
+ */
+static void set_cpu_deadline(unsigned int cpu_id, unsigned int start) {
+  simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+
+  cpu->burst_end = start + burst_ticks(cpu_id, cpu->current->remaining);
+  if (cpu->slice_end < cpu->burst_end) {
+    cpu->preempting = 1;
+    cpu_deadline[cpu_id] = cpu->slice_end;
+  } else {
+    cpu_deadline[cpu_id] = cpu->burst_end;
+  }
+}
+
+/* Returns the ticks a CPU takes to do the given work at its frequency */
+static unsigned int burst_ticks(unsigned int cpu_id, unsigned int work) {
+  unsigned int pct = cpu_freq_pct[simulator_cpu_data[cpu_id].freq_level];
+
+  return (work * 100 + pct - 1) / pct;
+}
+
+/*
+ * Clears the deadline of a CPU whose process is being preempted, and saves the
+ * part of the CPU burst that has not run yet in the process.  Below full
+ * speed the work left is rounded down, so a process preempted every tick
+ * still gets somewhere; a process preempted before the CPU woke up keeps
+ * all of its burst.
+ */
+static void save_cpu_burst(unsigned int cpu_id) {
+  simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+  pcb_t *pcb = cpu->current;
+  unsigned int work;
+
+  cpu_deadline[cpu_id] = TICK_NEVER;
+  if (pcb->pc->type == OP_CPU) {
+    work = cpu->burst_end > next_tick ? cpu->burst_end - next_tick : 0;
+    work = work * cpu_freq_pct[cpu->freq_level] / 100;
+    if (work < pcb->remaining) pcb->remaining = work;
+  }
+}
+
+/*
+ * The due CPUs are found in one scan at the start of the tick.  A CPU
+ * switched to a new process while they are handled gets a deadline of
+ * next_tick or later, so it can't become due again this tick.
+ */
+static void simulate_cpus(void) {
+  unsigned long long due;
+  unsigned int word, cpu_id;
+
+  /* Processes switched in from now on first run on the next tick */
+  next_tick = simulator_time + 1;
+
+  tick_scan(cpu_deadline, cpu_count, simulator_time, cpu_due);
+  for (word = 0; word < TICK_MASK_WORDS(cpu_count); word++) {
+    for (due = cpu_due[word]; due != 0; due &= due - 1) {
+      cpu_id = word * 64 + __builtin_ctzll(due);
+      cpu_deadline[cpu_id] = TICK_NEVER;
+      simulate_process(cpu_id, simulator_cpu_data[cpu_id].current);
     }
   }
 }
 
+static void preempt_process(unsigned int cpu_id) {
+  save_cpu_burst(cpu_id);
+  cpu_stats[cpu_id].preemptions++;
+  simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
+  REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_id].wakeup);
+  // wait to make sure thread finishes preempt and context switch
+  REPLAY_COND_WAIT(&thread_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
+}
+
+/*
+ * Moves a process's "PC" to its next operation, which when streaming may
+ * be in the next chunk
+ */
+static const op_t *next_op(pcb_t *pcb) {
+  pcb->pc = stream_enabled ? stream_next(pcb) : pcb->pc + 1;
+  pcb->remaining = pcb->pc->time;
+  return pcb->pc;
+}
+
 static void simulate_process(unsigned int cpu_id, pcb_t *pcb) {
   /*
    * The "program counter" is really just a pointer to the current position
    * in the operations array
    */
-  op_t *pc = (op_t *)pcb->pc;
+  const op_t *pc;
 
-  switch (pc->type) {
-    case OP_CPU:
-      /* Scheduling a running process ... good ... */
-
-      /* Check to see if the CPU burst has completed */
-      if (pc->time > 0) {
-        /* Simulate running the process */
-        pc->time--;
-
-        /* Simulate the preemption timer */
-        simulator_cpu_data[cpu_id].preemption_timer--;
-        if (simulator_cpu_data[cpu_id].preemption_timer == 0) {
-          /* The timer has expired; preempt the running process */
-          simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-          pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-          // wait to make sure thread finishes preempt and context switch
-          pthread_cond_wait(&thread_yielded, &simulator_mutex);
-        }
-      } else {
-        /* Move to the next operation */
-        pcb->pc = ((op_t *)(pcb->pc)) + 1;
-        pc++;
-
-        switch (pc->type) {
-          case OP_IO:
-            /* Put a request in the I/O FIFO queue */
-            submit_io_request(pcb, pc->time);
-
-            /* Generate a yield() call on the appropriate CPU */
-            simulator_cpu_data[cpu_id].state = CPU_YIELD;
-            pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-            // wait to make sure thread finishes yield and context switch
-            pthread_cond_wait(&thread_yielded, &simulator_mutex);
-            break;
-
-          case OP_TERMINATE:
-            /* Generate a terminate() call on the appropriate CPU */
-            simulator_cpu_data[cpu_id].state = CPU_TERMINATE;
-            pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-            // wait to make sure thread finishes terminate and context switch
-            pthread_cond_wait(&thread_yielded, &simulator_mutex);
-            break;
-
-          case OP_CPU:
-            break;
-        }
-      }
-      break;
+  if (simulator_cpu_data[cpu_id].preempting) {
+    /* The time slice has expired; preempt the running process */
+    preempt_process(cpu_id);
+    return;
+  }
+
+  /* The CPU burst has completed; move to the next operation */
+  pc = next_op(pcb);
+
+  /* Taking a free lock and releasing one take no time */
+  while (pc->type == OP_LOCK || pc->type == OP_UNLOCK) {
+    if (pc->type == OP_UNLOCK) {
+      release_lock(pcb, pc->time);
+    } else if (!acquire_lock(pcb, pc->time)) {
+      /* Blocked; generate a yield() call, as for I/O */
+      simulator_cpu_data[cpu_id].state = CPU_YIELD;
+      REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_id].wakeup);
+      // wait to make sure thread finishes yield and context switch
+      REPLAY_COND_WAIT(&thread_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
+      return;
+    }
+    pc = next_op(pcb);
+  }
 
+  switch (pc->type) {
     case OP_IO:
-      /* Scheduling a process that's blocked on I/O */
-      printf("Scheduled a process that's blocked on I/0! PID: %s\n", pcb->name);
+      /* Put a request in the I/O FIFO queue */
+      submit_io_request(pcb, pc->time);
+
+      /* Generate a yield() call on the appropriate CPU */
+      simulator_cpu_data[cpu_id].state = CPU_YIELD;
+      REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_id].wakeup);
+      // wait to make sure thread finishes yield and context switch
+      REPLAY_COND_WAIT(&thread_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
       break;
 
     case OP_TERMINATE:
-      /* Scheduling a process that's terminated */
-      printf("Scheduled a terminated process! PID: %s\n", pcb->name);
+      finish_tick[pcb->pid] = simulator_time;
+      if (stream_enabled) stream_close(pcb);
+
+      /* Generate a terminate() call on the appropriate CPU */
+      simulator_cpu_data[cpu_id].state = CPU_TERMINATE;
+      REPLAY_COND_SIGNAL(&simulator_cpu_data[cpu_id].wakeup);
+      // wait to make sure thread finishes terminate and context switch
+      REPLAY_COND_WAIT(&thread_yielded, &simulator_mutex, PROF_SIMULATOR_MUTEX);
+      break;
+
+    case OP_CPU:
+      /*
+       * Past a lock operation the process carries on with its next burst
+       * from this tick, in what is left of its time slice, just as if the
+       * two bursts were one.  If the slice runs out now, it is preempted.
+       */
+      set_cpu_deadline(cpu_id, simulator_time);
+      if (cpu_deadline[cpu_id] <= simulator_time) preempt_process(cpu_id);
       break;
+
+    case OP_LOCK:
+    case OP_UNLOCK:
+      break;
+  }
+}
+
+/*
+ * acquire_lock() gives a process a lock if it is free, and returns 1.
+ * Otherwise it puts the process at the back of the lock's waiters and
+ * returns 0.
+ */
+static int acquire_lock(pcb_t *pcb, unsigned int lock) {
+  sim_lock_t *l = &locks[lock];
+
+  assert(lock < lock_count && l->holder != pcb);
+  if (l->holder == NULL) {
+    l->holder = pcb;
+    return 1;
+  }
+
+  l->contentions++;
+  l->waiters++;
+  blocked_on[pcb->pid] = lock;
+  lock_next[pcb->pid] = NULL;
+  if (l->tail != NULL)
+    lock_next[l->tail->pid] = pcb;
+  else
+    l->head = pcb;
+  l->tail = pcb;
+  return 0;
+}
+
+/*
+ * release_lock() hands a lock on to the first process waiting for it,
+ * moving that process past its OP_LOCK.  It is woken up at the end of the
+ * tick by simulate_locks().
+ */
+static void release_lock(pcb_t *pcb, unsigned int lock) {
+  sim_lock_t *l = &locks[lock];
+  pcb_t *waiter = l->head;
+
+  assert(lock < lock_count && l->holder == pcb);
+  l->holder = waiter;
+  if (waiter == NULL) return;
+
+  l->head = lock_next[waiter->pid];
+  if (l->head == NULL) l->tail = NULL;
+  l->waiters--;
+  blocked_on[waiter->pid] = -1;
+  next_op(waiter);
+
+  lock_grants[lock_grant_count].holder = pcb;
+  lock_grants[lock_grant_count].waiter = waiter;
+  lock_grant_count++;
+}
+
+static void simulate_locks(void) {
+  unsigned int n;
+
+  for (n = 0; n < lock_grant_count; n++)
+    wake_batch[wake_batch_count++] = lock_grants[n].waiter;
+}
+
+/*
+ * Tells the student's code of the locks released this tick, wakes the
+ * processes woken this tick with one call to wake_up_batch(), and calls
+ * scheduler_tick() if it was asked for, all in one trip out of the
+ * simulator_mutex and into the student_lock.
+ */
+static void deliver_wakeups(void) {
+  unsigned int n;
+
+  if (wake_batch_count == 0 && !tick_hook) return;
+
+  pthread_mutex_unlock(&simulator_mutex);
+  IRWL_WRITER_LOCK(student_lock);
+  for (n = 0; n < lock_grant_count; n++)
+    lock_released(lock_grants[n].holder, lock_grants[n].waiter);
+  if (wake_batch_count > 0)
+    PROF_CALL(PROF_WAKE_UP, wake_up_batch(wake_batch, wake_batch_count));
+  if (tick_hook) scheduler_tick(tick_running);
+  IRWL_WRITER_UNLOCK(student_lock);
+  PROF_MUTEX_LOCK(&simulator_mutex, PROF_SIMULATOR_MUTEX);
+
+  lock_grant_count = 0;
+  wake_batch_count = 0;
+}
+
+/*
+ * Rebuilds the locks after a restore.  A process holds the locks it has
+ * taken and not released before its pc, and waits for the lock its pc is
+ * on if it is blocked.  The waiters of a lock are queued in pid order.
+ */
+static void rebuild_locks(void) {
+  const op_t *op;
+  unsigned int n, lock;
+  int held;
+
+  for (n = 0; n < process_count; n++) {
+    if (processes[n].state == PROCESS_NEW) continue;
+    for (lock = 0; lock < lock_count; lock++) {
+      held = 0;
+      for (op = process_ops[n]; op < processes[n].pc; op++) {
+        if (op->time != lock) continue;
+        if (op->type == OP_LOCK) held = 1;
+        if (op->type == OP_UNLOCK) held = 0;
+      }
+      if (held) {
+        assert(locks[lock].holder == NULL);
+        locks[lock].holder = &processes[n];
+      }
+    }
+  }
+  for (n = 0; n < process_count; n++) {
+    if (processes[n].state == PROCESS_WAITING &&
+        processes[n].pc->type == OP_LOCK) {
+      int acquired = acquire_lock(&processes[n], processes[n].pc->time);
+
+      assert(!acquired);
+      locks[processes[n].pc->time].contentions--;
+    }
   }
 }
 
@@ -489,27 +1388,33 @@ static void submit_io_request(pcb_t *pcb, unsigned int execution_time) {
   assert(r != NULL);
   r->pcb = pcb;
   r->execution_time = execution_time;
+  timer_init(&r->timer, TIMER_IO, 0);
   r->next = NULL;
+  io_queue_length++;
+  TRACE(TRACE_SUPERVISOR, TRACE_IO_REQUEST, TRACE_NO_CPU, pcb,
+        io_queue_length);
 
-  /* Add request to end of queue */
+  /*
+   * Add request to end of queue.  A request that arrives at an empty queue
+   * starts right away and completes execution_time ticks from now.
+   */
   if (io_queue_tail != NULL) {
     io_queue_tail->next = r;
     io_queue_tail = r;
   } else {
     io_queue_head = r;
     io_queue_tail = r;
+    timer_add(&timer_wheel, &r->timer, simulator_time + execution_time);
   }
 }
 
 static void simulate_io(void) {
-  if (io_queue_head == NULL) return; /* There are no I/O requests */
-
-  if (io_queue_head->execution_time-- <= 0) {
+  if (timer_expired(&timer_wheel, TIMER_IO) != NULL) {
     io_request *completed = io_queue_head;
     pcb_t *pcb;
 
     /* Move the programs "PC" to the next "instruction" */
-    completed->pcb->pc = ((op_t *)completed->pcb->pc) + 1;
+    next_op(completed->pcb);
 
     /*
      * Remove the I/O request from the queue before calling the student's
@@ -518,31 +1423,275 @@ static void simulate_io(void) {
      */
     pcb = completed->pcb;
     io_queue_head = completed->next;
-    if (io_queue_head == NULL) io_queue_tail = NULL;
+    io_queue_length--;
+    if (io_queue_head == NULL)
+      io_queue_tail = NULL;
+    else
+      timer_add(&timer_wheel, &io_queue_head->timer,
+                simulator_time + 1 + io_queue_head->execution_time);
     free(completed);
 
-    /* Call the student's wake_up() handler */
-    pthread_mutex_unlock(&simulator_mutex);
-    IRWL_WRITER_LOCK(student_lock);
-    wake_up(pcb);
-    IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
+    wake_batch[wake_batch_count++] = pcb;
   }
 }
 
+/*
+ * In an open system, every process whose arrival time falls in this tick
+ * is created, and the timer is set for the tick the next one falls in.
+ */
 static void simulate_creat(void) {
-  static int processes_created = 0;
+  if (timer_expired(&timer_wheel, TIMER_CREAT) != NULL) {
+    do {
+      arrival_tick[processes_created] = simulator_time;
+      if (stream_enabled) stream_open(&processes[processes_created]);
+      wake_batch[wake_batch_count++] = &processes[processes_created];
+      processes_created++;
+      if (open_loop) next_arrival += arrival_gap();
+    } while (open_loop && processes_created < job_count &&
+             next_arrival < simulator_time + 1);
+
+    /* Otherwise create the next process in 10 ticks */
+    if (processes_created < job_count)
+      timer_add(&timer_wheel, &creat_timer,
+                open_loop ? (unsigned int)next_arrival : simulator_time + 10);
+  }
+}
 
-  if ((simulator_time % 10) == 0 && processes_created < PROCESS_COUNT) {
-    /* Call student's wake_up() handler */
-    pthread_mutex_unlock(&simulator_mutex);
-    IRWL_WRITER_LOCK(student_lock);
-    wake_up(&processes[processes_created]);
-    IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
+/*
+ * Draws the time to the next arrival, in ticks, from an exponential
+ * distribution with mean 1 / arrival_rate.  The uniform draw is the top 53
+ * bits of a 64-bit xorshift generator.
+ */
+static double arrival_gap(void) {
+  double u;
+
+  arrival_seed ^= arrival_seed << 13;
+  arrival_seed ^= arrival_seed >> 7;
+  arrival_seed ^= arrival_seed << 17;
+  u = (arrival_seed >> 11) * (1.0 / 9007199254740992.0);
+  return -log(1.0 - u) / arrival_rate;
+}
+
+extern void simulator_open_loop(double rate, unsigned int jobs,
+                                unsigned int duration) {
+  assert(rate > 0.0 && jobs > 0);
+  open_loop = 1;
+  arrival_rate = rate / 10.0;
+  job_count = jobs;
+  run_duration = duration;
+  arrival_seed = 0x9e3779b97f4a7c15ull; /* any seed but 0 */
+}
+
+extern void simulator_checkpoint_at(unsigned int tick, const char *path) {
+  checkpoint_tick = tick;
+  checkpoint_path = path;
+}
+
+extern void simulator_restore_from(const char *path) { restore_path = path; }
+
+/*
+ * Writes a checkpoint of the simulation to checkpoint_path and exits.  It
+ * is called by the supervisor at the start of a tick, when the only thing
+ * that can be in progress is an idle CPU thread that has taken a process off
+ * the ready queue but not yet switched to it.  That process would be in
+ * neither the ready queue nor on a CPU, so if the processes don't add up the
+ * checkpoint is put off to the next tick.  The locks are not saved, as
+ * they can be rebuilt from the processes.
+ */
+static void take_checkpoint(void) {
+  checkpoint_t *c = checkpoint_alloc(cpu_count, process_count, lock_count);
+  pcb_t **ready = malloc(sizeof(pcb_t *) * process_count);
+  io_request *r;
+  unsigned int n, running = 0, blocked = 0;
+
+  assert(ready != NULL);
+
+  IRWL_READER_LOCK(student_lock)
+  c->ready_count = save_ready_queue(ready);
+  for (n = 0; n < c->ready_count; n++) c->ready[n] = ready[n]->pid;
+  for (n = 0; n < process_count; n++) {
+    c->process[n].pc = processes[n].pc - process_ops[n];
+    c->process[n].remaining = processes[n].remaining;
+    c->process[n].priority = processes[n].priority;
+    c->process[n].time_added = processes[n].time_added;
+    c->process[n].state = processes[n].state;
+    c->process[n].last_cpu = processes[n].last_cpu;
+  }
+  IRWL_READER_UNLOCK(student_lock)
+
+  for (n = 0; n < cpu_count; n++) {
+    if (simulator_cpu_data[n].current != NULL) {
+      c->cpu[n].current = simulator_cpu_data[n].current->pid;
+      running++;
+    } else {
+      c->cpu[n].current = -1;
+    }
+    c->cpu[n].preempting = simulator_cpu_data[n].preempting;
+    c->cpu[n].burst_end = simulator_cpu_data[n].burst_end;
+    c->cpu[n].slice_end = simulator_cpu_data[n].slice_end;
+    c->cpu[n].expires = cpu_deadline[n];
+    c->cpu[n].busy_ticks = cpu_stats[n].busy_ticks;
+    c->cpu[n].idle_ticks = cpu_stats[n].idle_ticks;
+    c->cpu[n].dispatches = cpu_stats[n].dispatches;
+    c->cpu[n].preemptions = cpu_stats[n].preemptions;
+    c->cpu[n].migrations = cpu_stats[n].migrations;
+    c->cpu[n].ready_seen = cpu_stats[n].ready_seen;
+  }
+
+  for (r = io_queue_head; r != NULL; r = r->next) {
+    c->io[c->io_count].pid = r->pcb->pid;
+    c->io[c->io_count].execution_time = r->execution_time;
+    c->io_count++;
+  }
+  c->io_expires = io_queue_head != NULL && io_queue_head->timer.pending
+                      ? io_queue_head->timer.expires
+                      : CHECKPOINT_NEVER;
+  c->creat_expires =
+      creat_timer.pending ? creat_timer.expires : CHECKPOINT_NEVER;
+
+  c->lock_workload = lock_workload;
+  for (n = 0; n < lock_count; n++) {
+    c->lock[n].contentions = locks[n].contentions;
+    c->lock[n].wait_ticks = locks[n].wait_ticks;
+    c->lock[n].stall_ticks = locks[n].stall_ticks;
+    blocked += locks[n].waiters;
+  }
 
-    processes_created++;
+  if (c->ready_count + running + c->io_count + blocked +
+          processes_terminated + (process_count - processes_created) !=
+      process_count) {
+    checkpoint_free(c);
+    free(ready);
+    return;
   }
+
+  c->simulator_time = simulator_time;
+  c->next_tick = next_tick;
+  c->processes_created = processes_created;
+  c->processes_terminated = processes_terminated;
+  c->ready_counter = ready_counter;
+  c->running_counter = running_counter;
+  c->waiting_counter = waiting_counter;
+  c->idle_ready_counter = idle_ready_counter;
+  c->context_switches = context_switches;
+  c->cache_migrations = cache_migrations;
+  c->socket_migrations = socket_migrations;
+  c->migration_penalty = migration_penalty;
+
+  if (checkpoint_write(c, checkpoint_path) != 0) exit(-1);
+  printf("\nCheckpoint at %.1f s written to %s\n",
+         (float)simulator_time / 10.0, checkpoint_path);
+  exit(0);
+}
+
+/*
+ * Starts the simulation from the checkpoint in restore_path.  It is called
+ * by start_simulator() before any CPU thread runs.
+ */
+static void restore_checkpoint(void) {
+  checkpoint_t *c = checkpoint_read(restore_path);
+  pcb_t **ready, **running;
+  io_request *r;
+  unsigned int n;
+
+  if (c == NULL) exit(-1);
+  if (c->cpu_count != cpu_count || c->process_count != process_count) {
+    fprintf(stderr,
+            "%s: checkpoint is of %u CPUs and %u processes, not %u and %u\n",
+            restore_path, c->cpu_count, c->process_count, cpu_count,
+            process_count);
+    exit(-1);
+  }
+  if (c->lock_workload != lock_workload || c->lock_count != lock_count) {
+    fprintf(stderr, "%s: checkpoint is %s the lock workload\n", restore_path,
+            c->lock_workload ? "of" : "not of");
+    exit(-1);
+  }
+  for (n = 0; n < c->ready_count; n++) assert(c->ready[n] < process_count);
+  for (n = 0; n < c->io_count; n++) assert(c->io[n].pid < process_count);
+
+  ready = malloc(sizeof(pcb_t *) * process_count);
+  running = malloc(sizeof(pcb_t *) * cpu_count);
+  assert(ready != NULL && running != NULL);
+
+  simulator_time = c->simulator_time;
+  next_tick = c->next_tick;
+  processes_created = c->processes_created;
+  processes_terminated = c->processes_terminated;
+  ready_counter = c->ready_counter;
+  running_counter = c->running_counter;
+  waiting_counter = c->waiting_counter;
+  idle_ready_counter = c->idle_ready_counter;
+  context_switches = c->context_switches;
+  cache_migrations = c->cache_migrations;
+  socket_migrations = c->socket_migrations;
+  migration_penalty = c->migration_penalty;
+  timer_wheel_init(&timer_wheel, simulator_time);
+
+  for (n = 0; n < process_count; n++) {
+    processes[n].pc = process_ops[n] + c->process[n].pc;
+    processes[n].remaining = c->process[n].remaining;
+    processes[n].priority = c->process[n].priority;
+    processes[n].time_added = c->process[n].time_added;
+    processes[n].state = c->process[n].state;
+    processes[n].last_cpu = c->process[n].last_cpu;
+    assert(processes[n].last_cpu < (int)cpu_count);
+  }
+  count_process_states();
+  rebuild_locks();
+  for (n = 0; n < lock_count; n++) {
+    locks[n].contentions = c->lock[n].contentions;
+    locks[n].wait_ticks = c->lock[n].wait_ticks;
+    locks[n].stall_ticks = c->lock[n].stall_ticks;
+  }
+
+  for (n = 0; n < cpu_count; n++) {
+    assert(c->cpu[n].current < (int)process_count);
+    running[n] =
+        c->cpu[n].current >= 0 ? &processes[c->cpu[n].current] : NULL;
+    simulator_cpu_data[n].current = running[n];
+    simulator_cpu_data[n].state = running[n] != NULL ? CPU_RUNNING : CPU_IDLE;
+    simulator_cpu_data[n].preempting = c->cpu[n].preempting;
+    simulator_cpu_data[n].batched = 0;
+    simulator_cpu_data[n].burst_end = c->cpu[n].burst_end;
+    simulator_cpu_data[n].slice_end = c->cpu[n].slice_end;
+    cpu_deadline[n] = c->cpu[n].expires;
+    cpu_stats[n].busy_ticks = c->cpu[n].busy_ticks;
+    cpu_stats[n].idle_ticks = c->cpu[n].idle_ticks;
+    cpu_stats[n].dispatches = c->cpu[n].dispatches;
+    cpu_stats[n].preemptions = c->cpu[n].preemptions;
+    cpu_stats[n].migrations = c->cpu[n].migrations;
+    cpu_stats[n].ready_seen = c->cpu[n].ready_seen;
+  }
+
+  for (n = 0; n < c->io_count; n++) {
+    r = malloc(sizeof(io_request));
+    assert(r != NULL);
+    r->pcb = &processes[c->io[n].pid];
+    r->execution_time = c->io[n].execution_time;
+    timer_init(&r->timer, TIMER_IO, 0);
+    r->next = NULL;
+    if (io_queue_tail != NULL)
+      io_queue_tail->next = r;
+    else
+      io_queue_head = r;
+    io_queue_tail = r;
+    io_queue_length++;
+  }
+  if (io_queue_head != NULL && c->io_expires != CHECKPOINT_NEVER)
+    timer_add(&timer_wheel, &io_queue_head->timer, c->io_expires);
+  if (c->creat_expires != CHECKPOINT_NEVER)
+    timer_add(&timer_wheel, &creat_timer, c->creat_expires);
+
+  /* The policy may stamp the processes it queues, so put the stamps back */
+  for (n = 0; n < c->ready_count; n++) ready[n] = &processes[c->ready[n]];
+  restore_scheduler(ready, c->ready_count, running);
+  for (n = 0; n < c->ready_count; n++)
+    processes[c->ready[n]].time_added = c->process[c->ready[n]].time_added;
+
+  checkpoint_free(c);
+  free(ready);
+  free(running);
 }
 
 /* Cheap hack -- passing an int through a void pointer */
@@ -561,4 +1710,6 @@ extern void mt_safe_usleep(unsigned long usec) {
     ;
 }
 
-extern unsigned int getSimulatorTime(void) { return simulator_time; }
+extern unsigned int getSimulatorTime(void) {
+  return __atomic_load_n(&simulator_time, __ATOMIC_RELAXED);
+}
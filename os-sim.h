@@ -24,6 +24,8 @@ typedef enum {
   PROCESS_TERMINATED
 } process_state_t;
 
+#define PROCESS_STATES (PROCESS_TERMINATED + 1)
+
 /*
  * The Process Control Block
  *
@@ -35,20 +37,40 @@ typedef enum {
  *        priority scheduling algorithm.  (0 = lowest priority;
  *        10 = highest priority; read-only)
  *
+ *   group : The process group the process belongs to, or 0 if it is in
+ *        none.  The processes of a group are threads of one program that
+ *        should run at the same time, and are gang scheduled with -g.
+ *        (read-only)
+ *
  *   state : The current state of the process.  This should be updated by the
- *        student's code in each of the handlers.  See the task_state_t
- *        struct above for possible values.
+ *        student's code in each of the handlers, with set_process_state().
+ *        See the task_state_t struct above for possible values.
  *
  *   pc : The "program counter" of the process.  This value is actually used
  *        by the simulator to simulate the process.  Do not touch.
  *
+ *   remaining : The time left of the operation at pc.  The operations
+ *        themselves are read-only, so that one workload can be run many
+ *        times; the simulator counts this down instead.  Do not touch.
+ *
+ *   last_cpu : The CPU the process last ran on, or -1 if it has not run
+ *        yet.  Set by the simulator in context_switch().  (read-only)
+ *
  *   next : An unused pointer to another PCB.  You may use this pointer to
  *        build a linked-list of PCBs.
+ *
+ * A process's operations are CPU bursts and I/O requests of the given
+ * time, and OP_LOCK and OP_UNLOCK of a simulated lock, whose number is
+ * given in place of the time.  Taking a free lock or releasing one takes no
+ * time.  A process that finds the lock held yields as for I/O, and waits in
+ * PROCESS_WAITING until the lock is released to it.
  */
 typedef enum {
   OP_CPU = 0,
   OP_IO,
-  OP_TERMINATE
+  OP_TERMINATE,
+  OP_LOCK,
+  OP_UNLOCK
 } op_type;
 
 typedef struct {
@@ -60,18 +82,111 @@ typedef struct _pcb_t {
   const unsigned int pid;
   const char *name;
   const unsigned int static_priority;
+  const unsigned int group;
   unsigned int priority;
   float time_added;
   process_state_t state;
-  op_t *pc;
+  const op_t *pc;
+  unsigned int remaining;
+  int last_cpu;
   struct _pcb_t *next;
 } pcb_t;
 
 /*
- * start_simulator() runs the OS simulation.  The number of CPUs (1-16) should
- * be passed as the parameter.
+ * The machine topology.  The CPUs are numbered socket by socket, and within
+ * a socket, by the groups of cores that share a last level cache.
+ *
+ *   sockets : The number of sockets.
+ *
+ *   cores_per_socket : The number of CPUs in each socket.
+ *
+ *   cores_per_cache : The number of CPUs sharing each cache, which must
+ *        divide cores_per_socket.
+ *
+ *   cache_penalty, socket_penalty : The ticks added to a process's CPU burst
+ *        when it is switched in on a CPU in a different cache, or a
+ *        different socket, from the one it last ran on.  They model the
+ *        cost of refilling the cache, and of reaching memory on the other
+ *        socket.
+ */
+typedef struct {
+  unsigned int sockets;
+  unsigned int cores_per_socket;
+  unsigned int cores_per_cache;
+  unsigned int cache_penalty;
+  unsigned int socket_penalty;
+} topology_t;
+
+/*
+ * start_simulator() runs the OS simulation.  The number of CPUs (1-16, or
+ * up to SIMULATOR_MAX_CPUS once simulator_quiet() has turned the Gantt chart
+ * off) should be passed as the first parameter, and the topology of those
+ * CPUs as the second, or NULL for one socket whose CPUs all share a cache.
+ */
+#define SIMULATOR_MAX_CPUS 1024
+
+extern void start_simulator(unsigned int cpu_count,
+                            const topology_t *topology);
+
+/*
+ * simulator_open_loop() makes the simulation an open system, and must be
+ * called before start_simulator().  Instead of one process every 10 ticks,
+ * processes arrive at random, on average rate of them a second, until jobs
+ * of them have arrived.  The run ends once they have all terminated, or
+ * after duration ticks if that is not 0, and the final stats add the
+ * throughput and response time percentiles.  The arrival times are the
+ * same from run to run, so runs differ only in the scheduler.
+ */
+extern void simulator_open_loop(double rate, unsigned int jobs,
+                                unsigned int duration);
+
+/*
+ * sort_ticks() sorts count times in ticks, shortest first.
+ * tick_percentile() returns the pct'th percentile (1-100) of count sorted
+ * times, by nearest rank; count must not be 0.
+ */
+extern void sort_ticks(unsigned int *ticks, unsigned int count);
+extern unsigned int tick_percentile(const unsigned int *ticks,
+                                    unsigned int count, unsigned int pct);
+
+/*
+ * simulator_scheduler_tick() makes the simulator call the student's
+ * scheduler_tick() at the end of every tick, with the process each CPU ran
+ * during the tick, or NULL for an idle CPU.  It must be called before
+ * start_simulator().
  */
-extern void start_simulator(unsigned int cpu_count);
+extern void simulator_scheduler_tick(void);
+
+/*
+ * Power management.  Each CPU runs at one of CPU_FREQ_LEVELS frequencies,
+ * level 0 being full speed.  At cpu_freq_pct[level] percent of full speed,
+ * a CPU burst of n ticks takes n * 100 / cpu_freq_pct[level] ticks, rounded
+ * up.  A CPU left idle for a few ticks drops from a shallow idle state into
+ * a deep sleep, and a process switched onto a sleeping CPU starts only
+ * once the CPU has woken up.
+ *
+ * simulator_energy_model() turns on the idle states' wake-up latency, and
+ * a report of the energy the CPUs used in the final stats.  It must be
+ * called before start_simulator().
+ *
+ * set_cpu_frequency() sets the frequency level of a CPU, from the next
+ * process switched onto it.  cpu_sleeping() returns nonzero if a CPU is
+ * idle in its deep sleep state.
+ */
+#define CPU_FREQ_LEVELS 3
+
+extern const unsigned int cpu_freq_pct[CPU_FREQ_LEVELS];
+
+extern void simulator_energy_model(void);
+extern void set_cpu_frequency(unsigned int cpu_id, unsigned int level);
+extern int cpu_sleeping(unsigned int cpu_id);
+
+/*
+ * cpu_socket() and cpu_cache() return the socket a CPU is in, and the
+ * cache it shares, counting caches across all the sockets.
+ */
+extern unsigned int cpu_socket(unsigned int cpu_id);
+extern unsigned int cpu_cache(unsigned int cpu_id);
 
 /*
  * context_switch() schedules a process on a CPU.  Note that it is
@@ -94,6 +209,28 @@ extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
  */
 extern void force_preempt(unsigned int cpu_id);
 
+/*
+ * force_preempt_batch() preempts the running processes on several CPUs at
+ * once, skipping the ids that are negative, and returns once they have all
+ * switched.  The CPUs reschedule in parallel, rather than one after another
+ * as they would with a force_preempt() each.
+ */
+extern void force_preempt_batch(const int *cpu_ids, unsigned int count);
+
+/*
+ * set_process_state() changes the state of a process.  The simulator keeps
+ * a count of the processes in each state up to date from it, rather than
+ * scanning the whole process table every tick, so always use it instead of
+ * assigning to pcb->state.
+ */
+extern void set_process_state(pcb_t *pcb, process_state_t state);
+
+/*
+ * lock_blocker() returns the process holding the lock a process is blocked
+ * on, or NULL if it isn't blocked on a lock.
+ */
+extern pcb_t *lock_blocker(pcb_t *pcb);
+
 /*
  * mt_safe_usleep() is a thread-safe implementation of the usleep() function.
  * See man usleep(3) for the behavior of this function.
@@ -0,0 +1,98 @@
+/*
+ * park.c
+ * Multithreaded OS Simulation
+ *
+ * Idle CPU parking on futexes.  See park.h for the interface.
+ */
+
+#include <assert.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "park.h"
+#include "replay.h"
+
+#define PARK_WORDS(n) (((n) + 63) / 64)
+
+/*
+ * park_token[cpu] is the futex word: 0 while the CPU is parked, and set to
+ * 1 by park_wake_one() when it claims the CPU.  Each is on a cache line of
+ * its own, as they are written by different threads.
+ */
+typedef struct {
+  unsigned int word;
+  char pad[64 - sizeof(unsigned int)];
+} park_token_t;
+
+static park_token_t *park_token;
+static unsigned long long *park_idle;
+static unsigned int park_cpus;
+
+extern void park_init(unsigned int cpu_count) {
+  park_cpus = cpu_count;
+  park_token = calloc(cpu_count, sizeof(park_token_t));
+  park_idle = calloc(PARK_WORDS(cpu_count), sizeof(unsigned long long));
+  assert(park_token != NULL && park_idle != NULL);
+}
+
+extern void park_mark_idle(unsigned int cpu_id) {
+  __atomic_store_n(&park_token[cpu_id].word, 0, __ATOMIC_SEQ_CST);
+  __atomic_fetch_or(&park_idle[cpu_id / 64], 1ull << (cpu_id % 64),
+                    __ATOMIC_SEQ_CST);
+}
+
+extern void park_unmark_idle(unsigned int cpu_id) {
+  __atomic_fetch_and(&park_idle[cpu_id / 64], ~(1ull << (cpu_id % 64)),
+                     __ATOMIC_SEQ_CST);
+}
+
+extern void park_wait(unsigned int cpu_id) {
+  unsigned int *word = &park_token[cpu_id].word;
+
+  if (replay_mode) {
+    replay_park(word);
+    return;
+  }
+
+  /* FUTEX_WAIT returns at once if the word is no longer 0 */
+  while (__atomic_load_n(word, __ATOMIC_ACQUIRE) == 0)
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+}
+
+extern int park_claim(void) { return park_claim_range(0, park_cpus); }
+
+extern int park_claim_range(unsigned int first, unsigned int count) {
+  unsigned long long idle, bit, range;
+  unsigned int n, last = first + count;
+
+  for (n = first / 64; n < PARK_WORDS(last); n++) {
+    /* the bits of this word that are in [first, last) */
+    range = ~0ull;
+    if (n == first / 64) range &= ~0ull << (first % 64);
+    if (n == last / 64) range &= (1ull << (last % 64)) - 1;
+
+    idle = __atomic_load_n(&park_idle[n], __ATOMIC_SEQ_CST);
+    while ((idle & range) != 0) {
+      bit = idle & range & -(idle & range);
+      if (__atomic_compare_exchange_n(&park_idle[n], &idle, idle & ~bit, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return (int)(n * 64 + __builtin_ctzll(bit));
+    }
+  }
+  return -1;
+}
+
+extern void park_wake(unsigned int cpu_id) {
+  __atomic_store_n(&park_token[cpu_id].word, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &park_token[cpu_id].word, FUTEX_WAKE_PRIVATE, 1, NULL,
+          NULL, 0);
+}
+
+extern int park_wake_one(void) {
+  int cpu_id = park_claim();
+
+  if (cpu_id >= 0) park_wake(cpu_id);
+  return cpu_id;
+}
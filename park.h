@@ -0,0 +1,68 @@
+/*
+ * park.h
+ * Multithreaded OS Simulation
+ *
+ * Per-CPU parking for idle CPU threads.
+ *
+ * An idle CPU thread parks on a futex word of its own, and sets its bit in
+ * a bitmask of idle CPUs.  Each time a process is added to the ready queue,
+ * park_wake_one() claims one idle CPU from the bitmask and wakes just that
+ * thread.  So every ready process gets a CPU of its own, rather than one
+ * broadcast waking every idle CPU, or one signal waking a single CPU however
+ * long the ready queue has grown.
+ *
+ * The protocol for an idle CPU is:
+ *
+ *   park_mark_idle(cpu);
+ *   if (nothing is ready) park_wait(cpu);
+ *   if (something is ready) { park_unmark_idle(cpu); run it; }
+ *   else start again
+ *
+ * where "is ready" is checked under the same lock the ready queue is
+ * updated under, and park_wake_one() is called after that lock is dropped.
+ * Then a wakeup can't be lost: either the idle CPU sees the new process, or
+ * park_wake_one() sees the idle CPU's bit.
+ */
+
+#ifndef __PARK_H__
+#define __PARK_H__
+
+/*
+ * park_init() sets up parking for the given number of CPUs, none of which
+ * is idle.
+ */
+extern void park_init(unsigned int cpu_count);
+
+/*
+ * park_mark_idle() adds a CPU to the idle bitmask; park_unmark_idle()
+ * takes it off again, if no one has claimed it in the meantime.
+ */
+extern void park_mark_idle(unsigned int cpu_id);
+extern void park_unmark_idle(unsigned int cpu_id);
+
+/*
+ * park_wait() sleeps until park_wake_one() claims the CPU.  It returns at
+ * once if the CPU was claimed since park_mark_idle().
+ */
+extern void park_wait(unsigned int cpu_id);
+
+/*
+ * park_wake_one() claims the lowest numbered idle CPU, wakes it, and
+ * returns its id, or returns -1 if no CPU is idle.
+ */
+extern int park_wake_one(void);
+
+/*
+ * park_claim() and park_wake() are the two halves of park_wake_one(), for
+ * a caller that has to hand the claimed CPU some work before waking it.
+ */
+extern int park_claim(void);
+extern void park_wake(unsigned int cpu_id);
+
+/*
+ * park_claim_range() is park_claim() for the count CPUs from first on, to
+ * keep a process near the caches it last ran in.
+ */
+extern int park_claim_range(unsigned int first, unsigned int count);
+
+#endif /* __PARK_H__ */
@@ -6,16 +6,28 @@
  * This file contains process data for the simulator.
  */
 
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "os-sim.h"
 #include "process.h"
 
 /*
  * Note: The operations must alternate: OP_CPU, OP_IO, OP_CPU, ...
  * In addition, the first and last operations must be OP_CPU.  Otherwise,
- * the simulator will not work.
+ * the simulator will not work.  OP_LOCK and OP_UNLOCK may come between
+ * them, but an OP_LOCK must be followed by an OP_CPU, and a process must
+ * release every lock it takes.
  */
 
-static op_t pid0_ops[] = {{OP_CPU, 2},
+/* The simulated locks, used by the lock workload (-L) */
+enum { LOCK_LOG, LOCK_DB, LOCK_COUNT };
+
+const char *const lock_names[] = {"log", "db"};
+const unsigned int lock_count = LOCK_COUNT;
+
+static const op_t pid0_ops[] = {{OP_CPU, 2},
                           {OP_IO, 2},
                           {OP_CPU, 3},
                           {OP_IO, 5},
@@ -46,7 +58,7 @@ static op_t pid0_ops[] = {{OP_CPU, 2},
                           {OP_CPU, 2},
                           {OP_TERMINATE, 0}};
 
-static op_t pid1_ops[] = {{OP_CPU, 3},
+static const op_t pid1_ops[] = {{OP_CPU, 3},
                           {OP_IO, 4},
                           {OP_CPU, 2},
                           {OP_IO, 6},
@@ -75,7 +87,7 @@ static op_t pid1_ops[] = {{OP_CPU, 3},
                           {OP_CPU, 4},
                           {OP_TERMINATE, 0}};
 
-static op_t pid2_ops[] = {{OP_CPU, 1},
+static const op_t pid2_ops[] = {{OP_CPU, 1},
                           {OP_IO, 4},
                           {OP_CPU, 2},
                           {OP_IO, 5},
@@ -102,7 +114,7 @@ static op_t pid2_ops[] = {{OP_CPU, 1},
                           {OP_CPU, 3},
                           {OP_TERMINATE, 0}};
 
-static op_t pid3_ops[] = {{OP_CPU, 9},
+static const op_t pid3_ops[] = {{OP_CPU, 9},
                           {OP_IO, 1},
                           {OP_CPU, 6},
                           {OP_IO, 1},
@@ -123,7 +135,7 @@ static op_t pid3_ops[] = {{OP_CPU, 9},
                           {OP_CPU, 8},
                           {OP_TERMINATE, 0}};
 
-static op_t pid4_ops[] = {{OP_CPU, 10},
+static const op_t pid4_ops[] = {{OP_CPU, 10},
                           {OP_IO, 1},
                           {OP_CPU, 14},
                           {OP_IO, 1},
@@ -144,7 +156,7 @@ static op_t pid4_ops[] = {{OP_CPU, 10},
                           {OP_CPU, 11},
                           {OP_TERMINATE, 0}};
 
-static op_t pid5_ops[] = {{OP_CPU, 9},
+static const op_t pid5_ops[] = {{OP_CPU, 9},
                           {OP_IO, 1},
                           {OP_CPU, 10},
                           {OP_IO, 2},
@@ -165,7 +177,7 @@ static op_t pid5_ops[] = {{OP_CPU, 9},
                           {OP_CPU, 8},
                           {OP_TERMINATE, 0}};
 
-static op_t pid6_ops[] = {{OP_CPU, 6},
+static const op_t pid6_ops[] = {{OP_CPU, 6},
                           {OP_IO, 3},
                           {OP_CPU, 9},
                           {OP_IO, 1},
@@ -186,7 +198,7 @@ static op_t pid6_ops[] = {{OP_CPU, 6},
                           {OP_CPU, 11},
                           {OP_TERMINATE, 0}};
 
-static op_t pid7_ops[] = {{OP_CPU, 6},
+static const op_t pid7_ops[] = {{OP_CPU, 6},
                           {OP_IO, 3},
                           {OP_CPU, 12},
                           {OP_IO, 3},
@@ -207,12 +219,100 @@ static op_t pid7_ops[] = {{OP_CPU, 6},
                           {OP_CPU, 9},
                           {OP_TERMINATE, 0}};
 
-pcb_t processes[PROCESS_COUNT] = {
-    {0, "Iapache", 8, PROCESS_NEW, 1, 0, pid0_ops},
-    {1, "Ibash", 7, PROCESS_NEW, 1, 0, pid1_ops},
-    {2, "Imozilla", 7, PROCESS_NEW, 1, 0, pid2_ops},
-    {3, "Ccpu", 5, PROCESS_NEW, 1, 0, pid3_ops},
-    {4, "Cgcc", 1, PROCESS_NEW, 1, 0, pid4_ops},
-    {5, "Cspice", 2, PROCESS_NEW, 1, 0, pid5_ops},
-    {6, "Cmysql", 4, PROCESS_NEW, 1, 0, pid6_ops},
-    {7, "Csim", 3, PROCESS_NEW, 1, 0, pid7_ops}};
+#define TEMPLATE_COUNT 8
+
+/*
+ * The templates form two process groups: a web server and its database,
+ * and a three-process simulation job (gcc building it while spice and the
+ * simulator run).  Each copy of the workload gets groups of its own.
+ */
+#define TEMPLATE_GROUPS 2
+
+/* remaining is set from the first operation when a copy is made */
+static const pcb_t templates[TEMPLATE_COUNT] = {
+    {0, "Iapache", 8, 1, PROCESS_NEW, 1, 0, pid0_ops, 0, -1, NULL},
+    {1, "Ibash", 7, 0, PROCESS_NEW, 1, 0, pid1_ops, 0, -1, NULL},
+    {2, "Imozilla", 7, 0, PROCESS_NEW, 1, 0, pid2_ops, 0, -1, NULL},
+    {3, "Ccpu", 5, 0, PROCESS_NEW, 1, 0, pid3_ops, 0, -1, NULL},
+    {4, "Cgcc", 1, 2, PROCESS_NEW, 1, 0, pid4_ops, 0, -1, NULL},
+    {5, "Cspice", 2, 2, PROCESS_NEW, 1, 0, pid5_ops, 0, -1, NULL},
+    {6, "Cmysql", 4, 1, PROCESS_NEW, 1, 0, pid6_ops, 0, -1, NULL},
+    {7, "Csim", 3, 2, PROCESS_NEW, 1, 0, pid7_ops, 0, -1, NULL}};
+
+/*
+ * The lock workload (-L) does the same work, but each template holds a lock
+ * for all but the first tick of every CPU burst of two ticks or more.  Half
+ * the templates share the log and half the database, and each lock is
+ * shared by high and low priority processes: Iapache and Imozilla with Cgcc
+ * and Csim, Ibash with Cspice and Cmysql.  A high priority process can be
+ * stuck behind a low priority one's critical section while middling
+ * priority processes run, which is a priority inversion.  Four processes
+ * that spend most of their CPU time holding the same lock keep it contended
+ * whatever the number of CPUs.
+ */
+static const unsigned int template_lock[TEMPLATE_COUNT] = {
+    LOCK_LOG, LOCK_DB, LOCK_LOG, LOCK_DB, LOCK_LOG, LOCK_DB, LOCK_DB, LOCK_LOG};
+
+/* Builds a template's operations for the lock workload */
+static const op_t *lock_ops(const op_t *ops, unsigned int lock) {
+  unsigned int n, count = 0;
+  op_t *locked;
+
+  for (n = 0; ops[n].type != OP_TERMINATE; n++) count++;
+  locked = malloc(sizeof(op_t) * (count * 4 + 1));
+  assert(locked != NULL);
+
+  for (count = 0;; ops++) {
+    if (ops->type == OP_CPU && ops->time >= 2) {
+      locked[count++] = (op_t){OP_CPU, 1};
+      locked[count++] = (op_t){OP_LOCK, lock};
+      locked[count++] = (op_t){OP_CPU, ops->time - 1};
+      locked[count++] = (op_t){OP_UNLOCK, lock};
+    } else {
+      locked[count++] = *ops;
+    }
+    if (ops->type == OP_TERMINATE) return locked;
+  }
+}
+
+pcb_t *processes = NULL;
+unsigned int process_count = 0;
+unsigned int group_count = 0;
+const op_t **process_ops = NULL;
+int lock_workload = 0;
+
+extern void create_processes(unsigned int copies, int locks) {
+  const op_t *template_ops[TEMPLATE_COUNT];
+  unsigned int n;
+
+  assert(copies > 0);
+  lock_workload = locks;
+  process_count = TEMPLATE_COUNT * copies;
+  group_count = TEMPLATE_GROUPS * copies;
+  processes = malloc(sizeof(pcb_t) * process_count);
+  assert(processes != NULL);
+  process_ops = malloc(sizeof(const op_t *) * process_count);
+  assert(process_ops != NULL);
+
+  /* Every copy of a template shares the template's operations */
+  for (n = 0; n < TEMPLATE_COUNT; n++) {
+    template_ops[n] =
+        locks ? lock_ops(templates[n].pc, template_lock[n]) : templates[n].pc;
+  }
+
+  for (n = 0; n < process_count; n++) {
+    const pcb_t *t = &templates[n % TEMPLATE_COUNT];
+    const op_t *ops = template_ops[n % TEMPLATE_COUNT];
+    unsigned int group =
+        t->group ? t->group + n / TEMPLATE_COUNT * TEMPLATE_GROUPS : 0;
+    pcb_t pcb = {n,           t->name,      t->static_priority,
+                 group,       t->priority,  t->time_added,
+                 t->state,    ops,          ops->time,
+                 -1,          NULL};
+
+    process_ops[n] = ops;
+
+    /* pcb_t has const members, so copy it in rather than assigning it */
+    memcpy(&processes[n], &pcb, sizeof(pcb_t));
+  }
+}
@@ -10,11 +10,38 @@
 #define __PROCESS_H__
 
 
-#define PROCESS_COUNT 8
-extern pcb_t processes[PROCESS_COUNT];
+/*
+ * processes[] is the process table, with process_count entries.  The pid of
+ * each process is its index in the table.
+ */
+extern pcb_t *processes;
+extern unsigned int process_count;
 
+/* The process groups are numbered 1 to group_count */
+extern unsigned int group_count;
 
+/*
+ * process_ops[] holds the start of each process's operations array, so a
+ * process's pc can be turned into an index and back.
+ */
+extern const op_t **process_ops;
 
+/*
+ * The simulated locks a workload may take, lock_count of them, numbered
+ * from 0 and named by lock_names[].  lock_workload is set if the processes
+ * take them.
+ */
+extern const char *const lock_names[];
+extern const unsigned int lock_count;
+extern int lock_workload;
+
+/*
+ * create_processes() builds the process table from the built-in workload of
+ * eight processes, repeated copies times.  Larger workloads are useful for
+ * benchmarking the simulator itself.  If locks is set, the processes take
+ * locks around most of their CPU bursts.
+ */
+extern void create_processes(unsigned int copies, int locks);
 
 #endif /* __PROCESS_H__ */
 
@@ -0,0 +1,132 @@
+/*
+ * prof.c
+ * Multithreaded OS Simulation
+ *
+ * Histograms and the exit report for the optional profiling build.  See
+ * prof.h for the interface.
+ */
+
+#ifdef PROFILE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "prof.h"
+
+/* Bucket n counts samples of [2^(n-1), 2^n) ns; bucket 0 counts 0 ns */
+#define PROF_BUCKETS 40
+
+typedef struct {
+  unsigned long long count;
+  unsigned long long waited;
+  unsigned long long total_ns;
+  unsigned long long max_ns;
+  unsigned long long bucket[PROF_BUCKETS];
+} prof_histogram_t;
+
+static prof_histogram_t prof_histogram[PROF_COUNT];
+
+static const char *prof_name[PROF_COUNT] = {
+    "idle()",          "preempt()",     "yield()",       "terminate()",
+    "wake_up_batch()", "ready_mutex",   "current_mutex", "simulator_mutex",
+    "IRWL reader",     "IRWL writer"};
+
+static void prof_report(void);
+
+extern unsigned long long prof_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * The histograms are shared by every thread, so they are updated with
+ * relaxed atomic adds rather than under a lock that would itself show up
+ * in the measurements.
+ */
+extern void prof_record(prof_id_t id, unsigned long long ns, int waited) {
+  prof_histogram_t *h = &prof_histogram[id];
+  unsigned long long max;
+  int b = 0;
+
+  while (b < PROF_BUCKETS - 1 && (ns >> b) != 0) b++;
+
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->total_ns, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->bucket[b], 1, __ATOMIC_RELAXED);
+  if (waited) __atomic_fetch_add(&h->waited, 1, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+  while (ns > max && !__atomic_compare_exchange_n(&h->max_ns, &max, ns, 1,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED))
+    ;
+}
+
+extern void prof_mutex_lock(pthread_mutex_t *mutex, prof_id_t id) {
+  unsigned long long start;
+
+  if (pthread_mutex_trylock(mutex) == 0) {
+    prof_record(id, 0, 0);
+    return;
+  }
+
+  start = prof_now();
+  pthread_mutex_lock(mutex);
+  prof_record(id, prof_now() - start, 1);
+}
+
+extern void prof_init(void) { atexit(prof_report); }
+
+/* Upper bound in ns of the bucket holding the given percentile */
+static unsigned long long prof_percentile(prof_histogram_t *h, double pct) {
+  unsigned long long want = (unsigned long long)(h->count * pct + 0.5);
+  unsigned long long seen = 0;
+  int b;
+
+  if (want == 0) want = 1;
+  for (b = 0; b < PROF_BUCKETS; b++) {
+    seen += h->bucket[b];
+    if (seen >= want) return b == 0 ? 0 : 1ull << b;
+  }
+  return h->max_ns;
+}
+
+static void prof_report(void) {
+  prof_histogram_t *h;
+  int n, b, first, last;
+
+  fprintf(stderr,
+          "\nProfile (wall-clock ns)\n"
+          "%-16s %9s %9s %11s %9s %9s %11s\n",
+          "", "count", "blocked", "mean", "p50 <=", "p99 <=", "max");
+  for (n = 0; n < PROF_COUNT; n++) {
+    h = &prof_histogram[n];
+    fprintf(stderr, "%-16s %9llu %9llu %11.0f %9llu %9llu %11llu\n",
+            prof_name[n], h->count, h->waited,
+            h->count ? (double)h->total_ns / h->count : 0.0,
+            prof_percentile(h, 0.50), prof_percentile(h, 0.99), h->max_ns);
+  }
+
+  /* One line per non-empty bucket, for the callbacks and contended locks */
+  for (n = 0; n < PROF_COUNT; n++) {
+    h = &prof_histogram[n];
+    first = -1;
+    last = -1;
+    for (b = 1; b < PROF_BUCKETS; b++) {
+      if (h->bucket[b] == 0) continue;
+      if (first < 0) first = b;
+      last = b;
+    }
+    if (first < 0) continue;
+
+    fprintf(stderr, "\n%s\n", prof_name[n]);
+    for (b = first; b <= last; b++)
+      fprintf(stderr, "  < %12llu ns %9llu\n", 1ull << b, h->bucket[b]);
+  }
+}
+
+#endif /* PROFILE */
@@ -0,0 +1,101 @@
+/*
+ * prof.h
+ * Multithreaded OS Simulation
+ *
+ * Optional wall-clock profiling of the scheduler callbacks and of the time
+ * threads spend waiting for the simulator's locks.  Build with -DPROFILE
+ * (make profile) to turn it on; otherwise the macros below compile down to
+ * the plain calls and cost nothing.
+ *
+ * Every timed call or lock wait is added to a log2 histogram of
+ * nanoseconds, and the histograms are printed to stderr when the simulator
+ * exits.
+ *
+ * The calls and locks are also the sequence points of a recorded or
+ * replayed run (see replay.h), in either build.
+ */
+
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include <pthread.h>
+
+#include "replay.h"
+
+typedef enum {
+  /* Scheduler callbacks */
+  PROF_IDLE = 0,
+  PROF_PREEMPT,
+  PROF_YIELD,
+  PROF_TERMINATE,
+  PROF_WAKE_UP,
+
+  /* Lock waits */
+  PROF_READY_MUTEX,
+  PROF_CURRENT_MUTEX,
+  PROF_SIMULATOR_MUTEX,
+  PROF_IRWL_READER,
+  PROF_IRWL_WRITER,
+
+  PROF_COUNT
+} prof_id_t;
+
+#ifdef PROFILE
+
+/*
+ * PROF_CALL() runs a statement and records how long it took.
+ */
+#define PROF_CALL(id, call)                       \
+  do {                                            \
+    REPLAY_POINT(id);                             \
+    unsigned long long _prof_start = prof_now();  \
+    call;                                         \
+    prof_record(id, prof_now() - _prof_start, 0); \
+  } while (0)
+
+/*
+ * PROF_MUTEX_LOCK() locks a mutex and records how long the caller waited
+ * for it.  An uncontended lock is recorded as a zero wait without reading
+ * the clock.
+ */
+#define PROF_MUTEX_LOCK(mutex, id) \
+  (replay_mode ? replay_mutex_lock(mutex, id) : prof_mutex_lock(mutex, id))
+
+/*
+ * PROF_WAIT_START() / PROF_WAIT_END() time a wait that isn't a plain mutex,
+ * such as a reader of the IRWL waiting for the writers to leave.
+ * PROF_WAITED() marks that the caller actually had to block.
+ */
+#define PROF_WAIT_START()                     \
+  unsigned long long _prof_wait = prof_now(); \
+  int _prof_waited = 0
+#define PROF_WAITED() _prof_waited = 1
+#define PROF_WAIT_END(id) \
+  prof_record(id, prof_now() - _prof_wait, _prof_waited)
+
+extern unsigned long long prof_now(void);
+extern void prof_record(prof_id_t id, unsigned long long ns, int waited);
+extern void prof_mutex_lock(pthread_mutex_t *mutex, prof_id_t id);
+
+/*
+ * prof_init() arranges for the report to be printed at exit.
+ */
+extern void prof_init(void);
+
+#else /* !PROFILE */
+
+#define PROF_CALL(id, call) \
+  do {                      \
+    REPLAY_POINT(id);       \
+    call;                   \
+  } while (0)
+#define PROF_MUTEX_LOCK(mutex, id) REPLAY_MUTEX_LOCK(mutex, id)
+#define PROF_WAIT_START()
+#define PROF_WAITED()
+#define PROF_WAIT_END(id)
+
+#define prof_init()
+
+#endif /* PROFILE */
+
+#endif /* __PROF_H__ */
@@ -0,0 +1,252 @@
+/*
+ * ready-bench.c
+ * Multithreaded OS Simulation
+ *
+ * Stress test and benchmark of the ready queues with many more threads and
+ * processes than the simulator runs.  It compares:
+ *
+ *   mutex : the StaticPriority policy's sorted list under one mutex, as the
+ *        core keeps it under ready_mutex.
+ *
+ *   lockfree : the inbox and skip list of readyq.c, as "-Q" keeps it.
+ *
+ * The CPU threads each take the next process off the queue and either put
+ * it straight back, as a preemption does, or, one time in four, hand it to
+ * the supervisor thread, which puts it back later, as a wake-up does.  Each
+ * process's place (queued, on a CPU or asleep) is changed with a compare
+ * and swap on every move, and the queue is emptied at the end, so a process
+ * lost or handed out twice is caught.  The output is CSV, one line per
+ * queue and thread count, with the queue and dequeue operations per second.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "os-sim.h"
+#include "readyq.h"
+#include "sched.h"
+
+#define READY_BENCH_PROCESSES 10000
+#define READY_BENCH_SECONDS 0.5
+
+/* Where a process is, kept apart from the queues to check them */
+enum { BENCH_QUEUED, BENCH_RUNNING, BENCH_ASLEEP };
+
+/* A queue under test: push, pop, or NULL if it looked empty */
+typedef struct {
+  const char *name;
+  void (*push)(pcb_t *proc);
+  pcb_t *(*pop)(void);
+} bench_queue_t;
+
+/* What the policies read from the core */
+int time_slice = -1;
+int max_wait_time;
+
+extern unsigned int sched_cpu_count(void) { return 1; }
+extern pcb_t *sched_current(unsigned int cpu_id) { return NULL; }
+extern unsigned int getSimulatorTime(void) { return 0; }
+
+static pcb_t *procs;
+static unsigned char *where;
+static unsigned long long errors;
+static int stop;
+
+/* The processes handed to the supervisor, a stack it takes all of at once */
+static pcb_t *asleep;
+
+static pthread_mutex_t mutex_lock = PTHREAD_MUTEX_INITIALIZER;
+static ready_queue_t mutex_queue;
+static readyq_t lockfree_queue;
+
+static void mutex_push(pcb_t *proc) {
+  pthread_mutex_lock(&mutex_lock);
+  sched_prio.enqueue(&mutex_queue, proc);
+  mutex_queue.count++;
+  pthread_mutex_unlock(&mutex_lock);
+}
+
+static pcb_t *mutex_pop(void) {
+  pcb_t *proc;
+
+  pthread_mutex_lock(&mutex_lock);
+  proc = sched_prio.dequeue(&mutex_queue);
+  if (proc != NULL) mutex_queue.count--;
+  pthread_mutex_unlock(&mutex_lock);
+  return proc;
+}
+
+static void lockfree_push(pcb_t *proc) {
+  readyq_push(&lockfree_queue, proc, proc->static_priority);
+}
+
+static pcb_t *lockfree_pop(void) { return readyq_pop(&lockfree_queue); }
+
+static const bench_queue_t queues[] = {{"mutex", mutex_push, mutex_pop},
+                                       {"lockfree", lockfree_push,
+                                        lockfree_pop}};
+
+/* Moves a process from one place to another, counting it if it wasn't */
+static void move(pcb_t *proc, unsigned char from, unsigned char to) {
+  if (!__atomic_compare_exchange_n(&where[proc->pid], &from, to, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+  const bench_queue_t *queue;
+  unsigned int seed;
+  unsigned long long ops;
+} bench_thread_t;
+
+static void *cpu_thread(void *arg) {
+  bench_thread_t *self = arg;
+  pcb_t *proc, *first;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    proc = self->queue->pop();
+    if (proc == NULL) continue;
+    move(proc, BENCH_QUEUED, BENCH_RUNNING);
+    self->ops++;
+
+    self->seed = self->seed * 1103515245 + 12345;
+    if ((self->seed >> 16) % 4 == 0) {
+      move(proc, BENCH_RUNNING, BENCH_ASLEEP);
+      first = __atomic_load_n(&asleep, __ATOMIC_RELAXED);
+      do {
+        proc->next = first;
+      } while (!__atomic_compare_exchange_n(&asleep, &first, proc, 1,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED));
+    } else {
+      move(proc, BENCH_RUNNING, BENCH_QUEUED);
+      self->queue->push(proc);
+      self->ops++;
+    }
+  }
+  return NULL;
+}
+
+/* Puts every sleeping process back on the queue, returning how many */
+static unsigned long long wake_all(const bench_queue_t *queue) {
+  pcb_t *proc = __atomic_exchange_n(&asleep, NULL, __ATOMIC_ACQUIRE);
+  pcb_t *next;
+  unsigned long long ops = 0;
+
+  for (; proc != NULL; proc = next) {
+    next = proc->next;
+    move(proc, BENCH_ASLEEP, BENCH_QUEUED);
+    queue->push(proc);
+    ops++;
+  }
+  return ops;
+}
+
+static void *supervisor_thread(void *arg) {
+  bench_thread_t *self = arg;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    self->ops += wake_all(self->queue);
+    usleep(10);
+  }
+  return NULL;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Runs one queue with the given number of CPU threads, returning the
+ * operations done, and checks every process is queued exactly once after.
+ */
+static unsigned long long bench(const bench_queue_t *queue,
+                                unsigned int threads, double *seconds) {
+  bench_thread_t *state = calloc(threads + 1, sizeof(bench_thread_t));
+  pthread_t *ids = malloc(sizeof(pthread_t) * (threads + 1));
+  unsigned char *seen = calloc(READY_BENCH_PROCESSES, 1);
+  unsigned long long ops = 0;
+  unsigned int n, found = 0;
+  pcb_t *proc;
+
+  memset(&mutex_queue, 0, sizeof(mutex_queue));
+  readyq_init(&lockfree_queue, READY_BENCH_PROCESSES);
+  memset(where, BENCH_QUEUED, READY_BENCH_PROCESSES);
+  for (n = 0; n < READY_BENCH_PROCESSES; n++) queue->push(&procs[n]);
+
+  stop = 0;
+  *seconds = now_s();
+  for (n = 0; n <= threads; n++) {
+    state[n].queue = queue;
+    state[n].seed = n + 1;
+    pthread_create(&ids[n], NULL, n < threads ? cpu_thread : supervisor_thread,
+                   &state[n]);
+  }
+  usleep(READY_BENCH_SECONDS * 1e6);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  for (n = 0; n <= threads; n++) {
+    pthread_join(ids[n], NULL);
+    ops += state[n].ops;
+  }
+  *seconds = now_s() - *seconds;
+
+  wake_all(queue);
+  while ((proc = queue->pop()) != NULL) {
+    if (seen[proc->pid]++ != 0) {
+      fprintf(stderr, "%s: process %u dequeued twice\n", queue->name,
+              proc->pid);
+      errors++;
+    }
+    move(proc, BENCH_QUEUED, BENCH_RUNNING);
+    found++;
+  }
+  if (found != READY_BENCH_PROCESSES) {
+    fprintf(stderr, "%s: %u of %u processes left on the queue\n", queue->name,
+            found, READY_BENCH_PROCESSES);
+    errors++;
+  }
+
+  free(state);
+  free(ids);
+  free(seen);
+  free(lockfree_queue.nodes);
+  return ops;
+}
+
+int main(void) {
+  static const unsigned int thread_counts[] = {1, 4, 16, 32};
+  unsigned long long ops;
+  unsigned int i, q, n;
+  double seconds;
+
+  procs = calloc(READY_BENCH_PROCESSES, sizeof(pcb_t));
+  where = malloc(READY_BENCH_PROCESSES);
+  for (n = 0; n < READY_BENCH_PROCESSES; n++) {
+    /* The PCB's identity is const, as the simulator hands it out */
+    pcb_t proc = {.pid = n, .name = "bench", .static_priority = rand() % 11};
+    memcpy(&procs[n], &proc, sizeof(proc));
+  }
+
+  printf("queue,threads,processes,ops,seconds,ops_per_s\n");
+  for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+    for (q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+      ops = bench(&queues[q], thread_counts[i], &seconds);
+      printf("%s,%u,%u,%llu,%.3f,%.0f\n", queues[q].name, thread_counts[i],
+             READY_BENCH_PROCESSES, ops, seconds, ops / seconds);
+    }
+  }
+
+  if (errors != 0) {
+    fprintf(stderr, "%llu processes lost, duplicated or moved twice\n",
+            errors);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * readyq.c
+ * Multithreaded OS Simulation
+ *
+ * The lock-free inbox and the skip list behind it.  See readyq.h for the
+ * interface.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "readyq.h"
+
+/*
+ * A node's key: the priority inverted in the top 16 bits, so that higher
+ * priorities sort first, and the order queued in the rest.
+ */
+#define READYQ_SEQ_BITS 48
+#define READYQ_PRIORITY_MAX 0xffffu
+
+static unsigned long long key_of(unsigned int priority,
+                                 unsigned long long seq) {
+  if (priority > READYQ_PRIORITY_MAX) priority = READYQ_PRIORITY_MAX;
+  return (unsigned long long)(READYQ_PRIORITY_MAX - priority)
+             << READYQ_SEQ_BITS |
+         (seq & ((1ull << READYQ_SEQ_BITS) - 1));
+}
+
+extern void readyq_init(readyq_t *q, unsigned int capacity) {
+  memset(q, 0, sizeof(*q));
+  pthread_mutex_init(&q->deleter, NULL);
+  q->levels = 1;
+  q->seed = 2463534242u;
+  q->capacity = capacity;
+  q->nodes = calloc(capacity, sizeof(readyq_node_t));
+  assert(q->nodes != NULL);
+}
+
+/*
+ * The count goes up before the process is in the inbox, so it never drops
+ * below the number there; a CPU that sees it early finds nothing to pop,
+ * and looks again.  The compare and swap releases the node to the deleter.
+ */
+extern void readyq_push(readyq_t *q, pcb_t *proc, unsigned int priority) {
+  readyq_node_t *node = &q->nodes[proc->pid];
+  readyq_node_t *first;
+
+  assert(proc->pid < q->capacity);
+  node->proc = proc;
+  node->key = key_of(priority, __atomic_fetch_add(&q->seq, 1,
+                                                  __ATOMIC_RELAXED));
+  __atomic_fetch_add(&q->count, 1, __ATOMIC_SEQ_CST);
+
+  first = __atomic_load_n(&q->inbox, __ATOMIC_RELAXED);
+  do {
+    node->inbox_next = first;
+  } while (!__atomic_compare_exchange_n(&q->inbox, &first, node, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* A level for a new node: one more with probability 1/2 each time */
+static unsigned int random_level(readyq_t *q) {
+  unsigned int level = 1;
+
+  q->seed ^= q->seed << 13;
+  q->seed ^= q->seed >> 17;
+  q->seed ^= q->seed << 5;
+  while (level < READYQ_LEVELS && (q->seed >> (level - 1) & 1)) level++;
+  return level;
+}
+
+/* Links a node into the skip list; the deleter lock must be held */
+static void insert(readyq_t *q, readyq_node_t *node) {
+  readyq_node_t *update[READYQ_LEVELS];
+  readyq_node_t *x = &q->head;
+  unsigned int level = random_level(q), l;
+
+  for (l = q->levels; l-- > 0;) {
+    while (x->next[l] != NULL && x->next[l]->key < node->key) x = x->next[l];
+    update[l] = x;
+  }
+  for (; q->levels < level; q->levels++) update[q->levels] = &q->head;
+
+  for (l = 0; l < level; l++) {
+    node->next[l] = update[l]->next[l];
+    update[l]->next[l] = node;
+  }
+}
+
+/* Sorts the inbox into the skip list; the deleter lock must be held */
+static void drain(readyq_t *q) {
+  readyq_node_t *node = __atomic_exchange_n(&q->inbox, NULL, __ATOMIC_ACQUIRE);
+  readyq_node_t *next;
+
+  for (; node != NULL; node = next) {
+    next = node->inbox_next;
+    insert(q, node);
+  }
+}
+
+extern pcb_t *readyq_pop(readyq_t *q) {
+  readyq_node_t *first;
+  pcb_t *proc = NULL;
+  unsigned int l;
+
+  pthread_mutex_lock(&q->deleter);
+  drain(q);
+  first = q->head.next[0];
+  if (first != NULL) {
+    // the first node is first on every level it is on
+    for (l = 0; l < q->levels && q->head.next[l] == first; l++)
+      q->head.next[l] = first->next[l];
+    while (q->levels > 1 && q->head.next[q->levels - 1] == NULL) q->levels--;
+    proc = first->proc;
+  }
+  pthread_mutex_unlock(&q->deleter);
+
+  if (proc != NULL) __atomic_fetch_sub(&q->count, 1, __ATOMIC_SEQ_CST);
+  return proc;
+}
+
+extern unsigned int readyq_count(readyq_t *q) {
+  return __atomic_load_n(&q->count, __ATOMIC_SEQ_CST);
+}
+
+extern unsigned int readyq_snapshot(readyq_t *q, pcb_t **procs) {
+  readyq_node_t *node;
+  unsigned int count = 0;
+
+  pthread_mutex_lock(&q->deleter);
+  drain(q);
+  for (node = q->head.next[0]; node != NULL; node = node->next[0])
+    procs[count++] = node->proc;
+  pthread_mutex_unlock(&q->deleter);
+  return count;
+}
@@ -0,0 +1,88 @@
+/*
+ * readyq.h
+ * Multithreaded OS Simulation
+ *
+ * A ready queue whose enqueue never blocks, for "-Q".
+ *
+ * The policies' ready queue is guarded by ready_mutex, so each wake-up on
+ * the supervisor and each preemption on a CPU waits for the CPUs taking
+ * processes off it, and the StaticPriority insert holds the lock for a walk
+ * of the whole queue.  This queue is ordered by priority, highest first,
+ * and then by the order the processes were queued in, as the FIFO,
+ * RoundRobin and StaticPriority policies order theirs.
+ *
+ * readyq_push() puts a process on a lock-free inbox with one compare and
+ * swap.  The queue has a single deleter at a time: readyq_pop() takes the
+ * deleter lock, moves the whole inbox into a skip list keyed on (priority,
+ * order queued), and unlinks the skip list's first process.  So the
+ * enqueuers never wait for anyone, and a dequeuer only waits for another
+ * dequeuer, for the O(log n) per process it takes to sort the inbox.
+ *
+ * The nodes are one per process, indexed by pid, and a process must not be
+ * pushed again until it has been popped.
+ */
+
+#ifndef __READYQ_H__
+#define __READYQ_H__
+
+#include <pthread.h>
+
+#include "os-sim.h"
+
+/* Enough levels for 64k processes at one node in two per level */
+#define READYQ_LEVELS 16
+
+typedef struct readyq_node {
+  pcb_t *proc;
+  unsigned long long key;
+  struct readyq_node *inbox_next;
+  struct readyq_node *next[READYQ_LEVELS];
+} readyq_node_t;
+
+typedef struct {
+  /* Changed by the enqueuers, atomically */
+  readyq_node_t *inbox;
+  unsigned long long seq;
+  unsigned int count;
+
+  /* Changed only under the deleter lock */
+  pthread_mutex_t deleter;
+  readyq_node_t head;
+  unsigned int levels;
+  unsigned int seed;
+
+  readyq_node_t *nodes;
+  unsigned int capacity;
+} readyq_t;
+
+/*
+ * readyq_init() sets up an empty queue for the processes with pids below
+ * capacity.
+ */
+extern void readyq_init(readyq_t *q, unsigned int capacity);
+
+/*
+ * readyq_push() queues a process at the given priority, higher first.
+ * Lock-free; any number of threads may push at once.
+ */
+extern void readyq_push(readyq_t *q, pcb_t *proc, unsigned int priority);
+
+/*
+ * readyq_pop() removes and returns the highest priority process queued
+ * longest, or NULL if there is none.
+ */
+extern pcb_t *readyq_pop(readyq_t *q);
+
+/*
+ * readyq_count() returns the number of processes queued, counting those
+ * still being pushed.
+ */
+extern unsigned int readyq_count(readyq_t *q);
+
+/*
+ * readyq_snapshot() copies the processes queued into procs[], in the order
+ * they would be popped, and returns how many there are.
+ */
+extern unsigned int readyq_snapshot(readyq_t *q, pcb_t **procs);
+
+#endif /* __READYQ_H__ */
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# regress.sh
+# Multithreaded OS Simulation
+#
+# Checks that a change to the simulator or the scheduler changed nothing
+# the simulation does.  Each run of a matrix of schedulers, CPU counts and
+# workloads is recorded with the baseline simulator (-R record) and then
+# replayed with the candidate (-R replay), so both see the same thread
+# interleaving, and their Gantt charts and final statistics are diffed.
+# It prints one line of CSV per run:
+#
+#   scheduler,cpus,workload,result
+#
+# where result is "same", "differs" if the output changed, or "diverged"
+# if the candidate took a different path through the locks and callbacks
+# than the baseline did.  The outputs of the runs that weren't the same are
+# kept, and the exit status is the number of them.
+#
+# The baseline is a simulator, or a git revision to build one from, which
+# must have -R.  A performance change should leave every run the same.
+#
+# Usage: ./regress.sh [baseline simulator | git revision] [candidate]
+#
+
+base=${1:-HEAD}
+sim=${2:-./os-sim-release}
+work=$(mktemp -d "${TMPDIR:-/tmp}/regress.XXXXXX")
+tree=
+
+if [ -x "$base" ]; then
+  baseline=$base
+else
+  tree=$work/tree
+  git worktree add -q --detach "$tree" "$base" || exit 1
+  make -s -C "$tree" os-sim-release || exit 1
+  baseline=$tree/os-sim-release
+fi
+
+failed=0
+echo "scheduler,cpus,workload,result"
+
+for sched in "fifo:" "rr:-r 4" "priority:-p" "mlfq:-m 4 10"; do
+  name=${sched%%:*}
+  args=${sched#*:}
+  for cpus in 1 2 4 8 16; do
+    for load in "built-in:" "copies:-w 8" "locks:-L -i" "gang:-g"; do
+      load_name=${load%%:*}
+      load_args=${load#*:}
+      run=$work/$name-$cpus-$load_name
+
+      # The line naming the mode is the only one that should differ
+      $baseline $cpus $args $load_args -R record $run.log 2> /dev/null |
+        grep -v "^recording " > $run.base
+      $sim $cpus $args $load_args -R replay $run.log 2> $run.err |
+        grep -v "^replaying " > $run.new
+      if grep -q "diverged" $run.err; then
+        result=diverged
+      elif cmp -s $run.base $run.new; then
+        result=same
+      else
+        result=differs
+      fi
+
+      echo "$name,$cpus,$load_name,$result"
+      if [ $result = same ]; then
+        rm -f $run.*
+      else
+        failed=$((failed + 1))
+      fi
+    done
+  done
+done
+
+if [ -n "$tree" ]; then
+  git worktree remove --force "$tree"
+fi
+if [ $failed -eq 0 ]; then
+  rmdir "$work"
+else
+  echo "$failed runs changed; the outputs are in $work" >&2
+fi
+exit $failed
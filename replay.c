@@ -0,0 +1,285 @@
+/*
+ * replay.c
+ * Multithreaded OS Simulation
+ *
+ * The turns of a recorded or replayed run.  See replay.h for the interface.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "prof.h"
+#include "replay.h"
+
+#define REPLAY_MAGIC "OSRR"
+#define REPLAY_VERSION 1
+
+/* The log's header; the turns follow, one unsigned short each */
+typedef struct {
+  char magic[4];
+  unsigned int version;
+  unsigned int cpu_count;
+} replay_header_t;
+
+/* A turn, as logged: the thread in the high byte, the event in the low */
+#define REPLAY_TURN(thread, event) ((unsigned short)((thread) << 8 | (event)))
+
+/* The supervisor's thread number, the CPU count, has to fit in the byte */
+#define REPLAY_MAX_CPUS 255
+
+/* A thread's wait on a condition variable, if it is in one */
+typedef struct {
+  pthread_cond_t *cond;
+  unsigned long since;
+  int signalled;
+} replay_thread_t;
+
+replay_mode_t replay_mode = REPLAY_OFF;
+
+static const char *replay_path;
+static FILE *replay_file;
+static unsigned int replay_cpus;
+
+/*
+ * replay_mutex guards everything below.  turn is the thread whose turn it
+ * is, or -1 between turns; every change that could let a waiting thread
+ * take the turn is broadcast on replay_changed.  next is the turn the log
+ * holds next when replaying, or -1 at its end.
+ */
+static pthread_mutex_t replay_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t replay_changed = PTHREAD_COND_INITIALIZER;
+static int turn = -1;
+static int next = -1;
+static unsigned long turns = 0, waits = 0;
+static replay_thread_t *threads;
+
+static __thread int self = -1;
+
+static const char *event_name[REPLAY_EVENTS] = {
+    "idle()",          "preempt()",     "yield()",       "terminate()",
+    "wake_up_batch()", "ready_mutex",   "current_mutex", "simulator_mutex",
+    "IRWL reader",     "IRWL writer",   "start",         "unpark"};
+
+static void replay_finish(void);
+
+extern int replay_open(const char *path, replay_mode_t mode,
+                       unsigned int cpu_count) {
+  replay_header_t header;
+  unsigned short first;
+
+  if (cpu_count > REPLAY_MAX_CPUS) {
+    fprintf(stderr, "-R works with at most %d CPUs\n", REPLAY_MAX_CPUS);
+    return -1;
+  }
+  replay_file = fopen(path, mode == REPLAY_RECORD ? "wb" : "rb");
+  if (replay_file == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  if (mode == REPLAY_RECORD) {
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.cpu_count = cpu_count;
+    if (fwrite(&header, sizeof(header), 1, replay_file) != 1) {
+      perror(path);
+      return -1;
+    }
+  } else {
+    if (fread(&header, sizeof(header), 1, replay_file) != 1 ||
+        memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != REPLAY_VERSION) {
+      fprintf(stderr, "%s is not a version %d replay log\n", path,
+              REPLAY_VERSION);
+      return -1;
+    }
+    if (header.cpu_count != cpu_count) {
+      fprintf(stderr, "%s was recorded on %u CPUs, not %u\n", path,
+              header.cpu_count, cpu_count);
+      return -1;
+    }
+    if (fread(&first, sizeof(first), 1, replay_file) == 1) next = first;
+  }
+
+  replay_path = path;
+  replay_cpus = cpu_count;
+  threads = calloc(cpu_count + 1, sizeof(replay_thread_t));
+  assert(threads != NULL);
+  replay_mode = mode;
+  atexit(replay_finish);
+  return 0;
+}
+
+static const char *thread_name(int thread, char *buf, size_t size) {
+  if (thread == (int)replay_cpus)
+    snprintf(buf, size, "the supervisor");
+  else
+    snprintf(buf, size, "CPU %d", thread);
+  return buf;
+}
+
+/*
+ * Called with replay_mutex held when the log says one thing and the run
+ * does another.  The run is stopped with _exit(), not exit(), as the
+ * reports run at exit would wait on the locks the other threads hold.
+ */
+static void diverged(unsigned short at) {
+  char logged[32], here[32];
+
+  fprintf(stderr, "Replay of %s diverged after %lu turns: ", replay_path,
+          turns);
+  if (next == at)
+    fprintf(stderr, "the log has %s take %s, but it is not free yet\n",
+            thread_name(at >> 8, here, sizeof(here)), event_name[at & 0xff]);
+  else if (next < 0)
+    fprintf(stderr, "the log has ended, but %s is at %s\n",
+            thread_name(at >> 8, here, sizeof(here)), event_name[at & 0xff]);
+  else
+    fprintf(stderr, "the log has %s at %s, but %s is at %s\n",
+            thread_name(next >> 8, logged, sizeof(logged)),
+            event_name[next & 0xff], thread_name(at >> 8, here, sizeof(here)),
+            event_name[at & 0xff]);
+  fflush(stdout);
+  _exit(-1);
+}
+
+/*
+ * Waits for the calling thread's turn at event, which when recording is
+ * the first time there is no turn and ready() is true, and when replaying
+ * the time the log gives the thread the turn.  As the run is the same up to
+ * then, ready() must be true when the log says so; it may take the lock
+ * the thread was waiting for.
+ */
+static void take_turn(int event, int (*ready)(void *), void *arg) {
+  unsigned short at = REPLAY_TURN(self, event);
+
+  assert(self >= 0);
+  pthread_mutex_lock(&replay_mutex);
+  while (1) {
+    if (turn < 0) {
+      if (replay_mode == REPLAY_RECORD) {
+        if (ready == NULL || ready(arg)) break;
+      } else if (next == at) {
+        if (ready == NULL || ready(arg)) break;
+        diverged(at);
+      } else if (next < 0 || next >> 8 == self) {
+        diverged(at);
+      }
+    }
+    pthread_cond_wait(&replay_changed, &replay_mutex);
+  }
+  turn = self;
+  turns++;
+
+  if (replay_mode == REPLAY_RECORD) {
+    if (fwrite(&at, sizeof(at), 1, replay_file) != 1) {
+      perror(replay_path);
+      exit(-1);
+    }
+  } else {
+    unsigned short logged;
+    next = fread(&logged, sizeof(logged), 1, replay_file) == 1 ? logged : -1;
+  }
+  pthread_mutex_unlock(&replay_mutex);
+}
+
+static void give_turn(void) {
+  pthread_mutex_lock(&replay_mutex);
+  assert(turn == self);
+  turn = -1;
+  pthread_cond_broadcast(&replay_changed);
+  pthread_mutex_unlock(&replay_mutex);
+}
+
+extern void replay_join(unsigned int thread) {
+  if (!replay_mode) return;
+  assert(thread <= replay_cpus);
+  self = thread;
+  take_turn(REPLAY_START, NULL, NULL);
+}
+
+extern void replay_point(int event) {
+  give_turn();
+  take_turn(event, NULL, NULL);
+}
+
+static int mutex_free(void *mutex) {
+  return pthread_mutex_trylock(mutex) == 0;
+}
+
+extern void replay_mutex_lock(pthread_mutex_t *mutex, int event) {
+  give_turn();
+  take_turn(event, mutex_free, mutex);
+}
+
+static int signalled(void *mutex) {
+  return threads[self].signalled && mutex_free(mutex);
+}
+
+extern void replay_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                             int event) {
+  pthread_mutex_lock(&replay_mutex);
+  threads[self].cond = cond;
+  threads[self].since = ++waits;
+  threads[self].signalled = 0;
+  pthread_mutex_unlock(&replay_mutex);
+
+  pthread_mutex_unlock(mutex);
+  give_turn();
+  take_turn(event, signalled, mutex);
+
+  pthread_mutex_lock(&replay_mutex);
+  threads[self].cond = NULL;
+  pthread_mutex_unlock(&replay_mutex);
+}
+
+/* Signals the longest waiter, so the choice is the same every run */
+extern void replay_cond_signal(pthread_cond_t *cond) {
+  replay_thread_t *oldest = NULL;
+  unsigned int n;
+
+  pthread_mutex_lock(&replay_mutex);
+  for (n = 0; n <= replay_cpus; n++) {
+    if (threads[n].cond != cond || threads[n].signalled) continue;
+    if (oldest == NULL || threads[n].since < oldest->since)
+      oldest = &threads[n];
+  }
+  if (oldest != NULL) oldest->signalled = 1;
+  pthread_mutex_unlock(&replay_mutex);
+}
+
+extern void replay_cond_broadcast(pthread_cond_t *cond) {
+  unsigned int n;
+
+  pthread_mutex_lock(&replay_mutex);
+  for (n = 0; n <= replay_cpus; n++)
+    if (threads[n].cond == cond) threads[n].signalled = 1;
+  pthread_mutex_unlock(&replay_mutex);
+}
+
+static int unparked(void *word) {
+  return __atomic_load_n((unsigned int *)word, __ATOMIC_ACQUIRE) != 0;
+}
+
+extern void replay_park(unsigned int *word) {
+  give_turn();
+  take_turn(REPLAY_PARK, unparked, word);
+}
+
+/* The summary goes to stderr, to leave stdout the same in both modes */
+static void replay_finish(void) {
+  pthread_mutex_lock(&replay_mutex);
+  if (replay_mode == REPLAY_RECORD) {
+    if (fclose(replay_file) != 0) perror(replay_path);
+    fprintf(stderr, "Recorded %lu turns to %s\n", turns, replay_path);
+  } else {
+    fclose(replay_file);
+    fprintf(stderr, "Replayed %lu turns from %s%s\n", turns, replay_path,
+            next < 0 ? "" : ", stopping before the end of the log");
+  }
+  pthread_mutex_unlock(&replay_mutex);
+}
@@ -0,0 +1,99 @@
+/*
+ * replay.h
+ * Multithreaded OS Simulation
+ *
+ * Recording the interleaving of the simulator's threads, and replaying it.
+ *
+ * The CPU threads and the supervisor run the student's code concurrently,
+ * so two runs with the same arguments can differ: which idle CPU takes a
+ * process off the ready queue, and on which tick, depends on how the host
+ * schedules the threads.  That makes comparing two builds noisy.
+ *
+ * With "-R record <file>" the threads take turns: only the thread holding
+ * the turn runs, and it gives it up at each sequence point, which is every
+ * entry to a scheduler callback, every lock of the simulator's mutexes and
+ * of the IRWL, every return from a condition variable wait, and every
+ * return from parking an idle CPU.  Whichever waiting thread the host runs
+ * first takes the turn, and the log is the thread and sequence point of
+ * each turn, in order.  As the code between two sequence points runs on its
+ * own, the log fixes everything it reads, including the time and the state
+ * counts read unlocked.
+ *
+ * With "-R replay <file>" each turn goes to the thread the log names, so
+ * the run takes the same decisions in the same order, and prints the same
+ * Gantt chart and statistics, however the host schedules it.  If a thread
+ * is at a different sequence point from the one logged, the code took a
+ * different path, and the replay stops with where it diverged.
+ *
+ * A mutex, condition variable or parking lot used by the threads in either
+ * mode has to go through the calls below, so that no thread blocks while
+ * holding the turn.  The stream reader (see stream.h) only touches its own
+ * state, and runs outside the turns.
+ */
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <pthread.h>
+
+typedef enum { REPLAY_OFF = 0, REPLAY_RECORD, REPLAY_REPLAY } replay_mode_t;
+
+/* Set by replay_open(), before any of the simulator's threads start */
+extern replay_mode_t replay_mode;
+
+/*
+ * The sequence points are the ids of prof.h, for the scheduler callbacks
+ * and the locks, and these two.
+ */
+#define REPLAY_START PROF_COUNT
+#define REPLAY_PARK (PROF_COUNT + 1)
+#define REPLAY_EVENTS (PROF_COUNT + 2)
+
+/*
+ * replay_open() records the interleaving to the file at path, or replays
+ * it from there, for the given number of CPUs.  It returns 0, or -1 after
+ * printing the reason to stderr.
+ */
+extern int replay_open(const char *path, replay_mode_t mode,
+                       unsigned int cpu_count);
+
+/*
+ * replay_join() makes the calling thread a CPU thread, or the supervisor if
+ * thread is the CPU count, and waits for its first turn.  It does nothing
+ * unless recording or replaying.
+ */
+extern void replay_join(unsigned int thread);
+
+/*
+ * The calls the macros below make when recording or replaying.
+ * replay_point() gives up the turn and waits for the next one.  The others
+ * are pthread_mutex_lock(), pthread_cond_wait(), pthread_cond_signal() and
+ * pthread_cond_broadcast(), taking the turn back once the lock is free or
+ * the wait signalled, and replay_park() waits for park_wake() to set the
+ * futex word.
+ */
+extern void replay_point(int event);
+extern void replay_mutex_lock(pthread_mutex_t *mutex, int event);
+extern void replay_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                             int event);
+extern void replay_cond_signal(pthread_cond_t *cond);
+extern void replay_cond_broadcast(pthread_cond_t *cond);
+extern void replay_park(unsigned int *word);
+
+#define REPLAY_POINT(event)               \
+  do {                                    \
+    if (replay_mode) replay_point(event); \
+  } while (0)
+#define REPLAY_MUTEX_LOCK(mutex, event)          \
+  (replay_mode ? replay_mutex_lock(mutex, event) \
+               : (void)pthread_mutex_lock(mutex))
+#define REPLAY_COND_WAIT(cond, mutex, event)          \
+  (replay_mode ? replay_cond_wait(cond, mutex, event) \
+               : (void)pthread_cond_wait(cond, mutex))
+#define REPLAY_COND_SIGNAL(cond) \
+  (replay_mode ? replay_cond_signal(cond) : (void)pthread_cond_signal(cond))
+#define REPLAY_COND_BROADCAST(cond)           \
+  (replay_mode ? replay_cond_broadcast(cond) \
+               : (void)pthread_cond_broadcast(cond))
+
+#endif /* __REPLAY_H__ */
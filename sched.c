@@ -0,0 +1,79 @@
+/*
+ * sched.c
+ * Multithreaded OS Simulation
+ *
+ * The policy registry and the list helpers shared by the policies.  See
+ * sched.h for the interface.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sched.h"
+
+static const sched_ops_t *sched_builtin[] = {&sched_fifo, &sched_rr,
+                                             &sched_prio, &sched_mlfq};
+
+#define SCHED_BUILTIN_COUNT (sizeof(sched_builtin) / sizeof(sched_builtin[0]))
+
+/* Set by -K; the policy code owns it, so it links without the core */
+unsigned int preempt_threshold = 1;
+
+extern const sched_ops_t *sched_lookup(const char *name) {
+  const sched_ops_t *ops;
+  size_t n, len = strlen(name);
+  void *handle;
+
+  for (n = 0; n < SCHED_BUILTIN_COUNT; n++) {
+    if (strcmp(sched_builtin[n]->name, name) == 0) return sched_builtin[n];
+  }
+
+  if (len < 3 || strcmp(name + len - 3, ".so") != 0) return NULL;
+
+  /* The plugin calls back into the core, so resolve its symbols now */
+  handle = dlopen(name, RTLD_NOW);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return NULL;
+  }
+  ops = dlsym(handle, "sched_plugin");
+  if (ops == NULL) {
+    fprintf(stderr, "%s: no sched_plugin symbol\n", name);
+    dlclose(handle);
+    return NULL;
+  }
+  return ops;
+}
+
+extern void pcb_list_append(pcb_list_t *list, pcb_t *proc) {
+  proc->next = NULL;
+  if (list->head == NULL) {
+    list->head = proc;
+  } else {
+    list->tail->next = proc;
+  }
+  list->tail = proc;
+}
+
+extern pcb_t *pcb_list_pop(pcb_list_t *list) {
+  pcb_t *first = list->head;
+
+  if (first == NULL) return NULL;
+
+  list->head = first->next;
+  if (list->head == NULL) list->tail = NULL;
+  first->next = NULL;
+  return first;
+}
+
+/* Unlinks proc, which follows prev (or is the head if prev is NULL) */
+extern void pcb_list_remove(pcb_list_t *list, pcb_t *prev, pcb_t *proc) {
+  if (prev == NULL) {
+    list->head = proc->next;
+  } else {
+    prev->next = proc->next;
+  }
+  if (list->tail == proc) list->tail = prev;
+  proc->next = NULL;
+}
@@ -0,0 +1,142 @@
+/*
+ * sched.h
+ * Multithreaded OS Simulation
+ *
+ * The scheduler plugin interface.
+ *
+ * The scheduler in student.c is split into a core, which implements the
+ * callbacks the simulator makes (idle(), preempt(), yield(), terminate(),
+ * wake_up_batch()) and owns the ready queue and its locking, and a policy,
+ * which decides the order processes run in.  A policy is a sched_ops_t table of
+ * functions; the core picks one at startup and then calls through it, so no
+ * call on the hot path has to check which algorithm is in use.
+ *
+ * The built-in policies are FIFO, RoundRobin, StaticPriority and MultiLevel.
+ * A new policy can be written as a shared object that exports a sched_ops_t
+ * named sched_plugin and loaded with "-s ./policy.so", without changing the
+ * core.
+ */
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "os-sim.h"
+
+/* Number of priority levels in the ready queue */
+#define SCHED_LEVELS 4
+
+/* A FIFO list of PCBs chained through their next pointers */
+typedef struct {
+  pcb_t *head;
+  pcb_t *tail;
+} pcb_list_t;
+
+/*
+ * The ready queue handed to a policy.  Policies which only need one queue
+ * use level[0]; count is kept by the core.
+ */
+typedef struct {
+  pcb_list_t level[SCHED_LEVELS];
+  unsigned int count;
+} ready_queue_t;
+
+/*
+ * The policy operations.
+ *
+ *   name : the name the policy is selected by with -s.
+ *
+ *   enqueue : adds a process to the ready queue.  Called with ready_mutex
+ *        held.
+ *
+ *   dequeue : removes and returns the next process to run, or NULL if the
+ *        ready queue is empty.  Called with ready_mutex held.
+ *
+ *   on_preempt : called when a process is preempted, before it is put back
+ *        on the ready queue.  May be NULL.
+ *
+ *   on_wake : called when a process is created or finishes I/O, before it
+ *        is put on the ready queue.  Returns the id of a CPU to preempt in
+ *        favour of the process, or -1.  May be NULL.
+ *
+ *   on_wake_batch : on_wake for all the processes woken on one tick, from
+ *        one look at the CPUs.  Sets victims[n] to the CPU to preempt in
+ *        favour of procs[n], or -1, picking each CPU at most once.  May be
+ *        NULL, in which case on_wake is asked about each process in turn.
+ *
+ *   on_tick : called with the current tick before every dequeue, so a
+ *        policy can age its queues.  Called with ready_mutex held.  May be
+ *        NULL.
+ *
+ *   slice_for : returns the time slice to run a process for, or -1 for no
+ *        time slice.
+ *
+ *   on_block : called with priority inheritance on (-i) when waiter blocks
+ *        on a lock held by holder, and for each holder down a chain of
+ *        blocked holders.  Also called for each process still blocked on a
+ *        lock holder holds after on_unlock.  Returns nonzero if it raised
+ *        holder's priority, after which the core requeues holder if it is
+ *        ready.  Called with ready_mutex held.  May be NULL.
+ *
+ *   on_unlock : called with priority inheritance on when a lock another
+ *        process is blocked on changes hands, for the process releasing it
+ *        and the one taking it, to drop all the priority it inherited.  The
+ *        core then lends it again the priority of the processes still
+ *        blocked on its locks, with on_block.  Called with ready_mutex
+ *        held.  May be NULL.
+ */
+typedef struct {
+  const char *name;
+  void (*enqueue)(ready_queue_t *rq, pcb_t *proc);
+  pcb_t *(*dequeue)(ready_queue_t *rq);
+  void (*on_preempt)(pcb_t *proc);
+  int (*on_wake)(pcb_t *proc);
+  void (*on_tick)(ready_queue_t *rq, unsigned int now);
+  int (*slice_for)(pcb_t *proc);
+  int (*on_block)(pcb_t *waiter, pcb_t *holder);
+  void (*on_unlock)(pcb_t *holder);
+  void (*on_wake_batch)(pcb_t **procs, unsigned int count, int *victims);
+} sched_ops_t;
+
+/* Built-in policies */
+extern const sched_ops_t sched_fifo;
+extern const sched_ops_t sched_rr;
+extern const sched_ops_t sched_prio;
+extern const sched_ops_t sched_mlfq;
+
+/*
+ * Scheduler parameters set on the command line, and changed by -T while
+ * the simulation runs
+ */
+extern int time_slice;
+extern int max_wait_time;
+
+/*
+ * The least gap between a waking process's priority and a running one's
+ * for the StaticPriority policy to preempt it (-K), 1 by default
+ */
+extern unsigned int preempt_threshold;
+
+/*
+ * sched_lookup() returns the built-in policy with the given name, or loads
+ * the policy from a shared object if name is a path ending in ".so".
+ * Returns NULL if there is no such policy.
+ */
+extern const sched_ops_t *sched_lookup(const char *name);
+
+/*
+ * sched_cpu_count() returns the number of CPUs being simulated.
+ */
+extern unsigned int sched_cpu_count(void);
+
+/*
+ * sched_current() returns the process currently running on a CPU, or NULL
+ * if the CPU is idle.
+ */
+extern pcb_t *sched_current(unsigned int cpu_id);
+
+/* Helpers for the lists of the ready queue */
+extern void pcb_list_append(pcb_list_t *list, pcb_t *proc);
+extern pcb_t *pcb_list_pop(pcb_list_t *list);
+extern void pcb_list_remove(pcb_list_t *list, pcb_t *prev, pcb_t *proc);
+
+#endif /* __SCHED_H__ */
@@ -0,0 +1,28 @@
+/*
+ * sched_fifo.c
+ * Multithreaded OS Simulation
+ *
+ * First-come first-served scheduling: processes run in the order they
+ * became ready, each until it blocks or terminates.
+ */
+
+#include <stddef.h>
+
+#include "sched.h"
+
+static void fifo_enqueue(ready_queue_t *rq, pcb_t *proc) {
+  pcb_list_append(&rq->level[0], proc);
+}
+
+static pcb_t *fifo_dequeue(ready_queue_t *rq) {
+  return pcb_list_pop(&rq->level[0]);
+}
+
+static int fifo_slice_for(pcb_t *proc) { return -1; }
+
+const sched_ops_t sched_fifo = {
+    .name = "fifo",
+    .enqueue = fifo_enqueue,
+    .dequeue = fifo_dequeue,
+    .slice_for = fifo_slice_for,
+};
@@ -0,0 +1,267 @@
+/*
+ * sched_gang.c
+ * Multithreaded OS Simulation
+ *
+ * Gang scheduling of process groups.  See sched_gang.h for the interface.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os-sim.h"
+#include "park.h"
+#include "process.h"
+#include "prof.h"
+#include "sched_gang.h"
+#include "student.h"
+#include "trace.h"
+
+static void gang_update(gang_t *g);
+static gang_t *gang_next(unsigned int free_cpus);
+static void gang_account(void);
+static void gang_report(void);
+
+int gang = 0;
+
+static gang_t *gangs;
+static pcb_t **handoff;
+static unsigned char *gang_starting;
+static unsigned int gang_seq = 0, gang_waiting = 0, idle_cpus = 0;
+
+/*
+ * gang statistics: dispatches, those started in one tick, and the idle CPU
+ * ticks while a group waited, accumulated up to gang_since
+ */
+static unsigned int gang_dispatches = 0, gang_coscheduled = 0;
+static unsigned long long gang_idle_ticks = 0;
+static unsigned int gang_since = 0;
+
+extern void gang_init(void) {
+  gangs = calloc(group_count + 1, sizeof(gang_t));
+  gang_starting = calloc(process_count, 1);
+  handoff = calloc(sched_cpu_count(), sizeof(pcb_t *));
+  assert(gangs != NULL && gang_starting != NULL && handoff != NULL);
+  for (unsigned int n = 0; n < process_count; n++)
+    gangs[processes[n].group].size++;
+  atexit(gang_report);
+}
+
+extern int gang_member(pcb_t *proc) {
+  return gang && proc->group != 0 && gangs[proc->group].size > 1 &&
+         gangs[proc->group].size <= sched_cpu_count();
+}
+
+extern void gang_idle(int delta) {
+  gang_account();
+  idle_cpus += delta;
+}
+
+extern int gang_handed(unsigned int cpu_id) { return handoff[cpu_id] != NULL; }
+
+extern int gang_ready(int parked) {
+  return gang_next(idle_cpus + !parked) != NULL;
+}
+
+extern int gang_enqueue(pcb_t *proc) {
+  gang_t *g = &gangs[proc->group];
+
+  if (proc->state == PROCESS_NEW) g->live++;
+  pcb_list_append(&g->ready, proc);
+  g->ready_count++;
+  set_process_state(proc, PROCESS_READY);
+  gang_update(g);
+  return gang_next(idle_cpus) != NULL;
+}
+
+extern pcb_t *gang_take(unsigned int cpu_id) {
+  pcb_t *proc;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  proc = handoff[cpu_id];
+  handoff[cpu_id] = NULL;
+  pthread_mutex_unlock(&ready_mutex);
+  return proc != NULL ? proc : gang_dispatch(cpu_id, 0);
+}
+
+extern pcb_t *gang_dispatch(int self, int can_preempt) {
+  unsigned int cpu_count = sched_cpu_count();
+  pcb_t *member[cpu_count];
+  pcb_t *mine = NULL;
+  unsigned int victim[cpu_count];
+  unsigned int need, free_cpus, victims = 0, n = 0, c;
+  gang_t *g;
+  int claimed;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+
+  free_cpus = idle_cpus + (self >= 0);
+  g = gang_next(can_preempt ? cpu_count : free_cpus);
+  if (g == NULL) {
+    pthread_mutex_unlock(&ready_mutex);
+    return NULL;
+  }
+
+  need = g->ready_count;
+  if (need > free_cpus) {
+    PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+    for (c = 0; c < cpu_count && free_cpus + victims < need; c++) {
+      if (current[c] != NULL && !gang_member(current[c]) &&
+          handoff[c] == NULL)
+        victim[victims++] = c;
+    }
+    pthread_mutex_unlock(&current_mutex);
+
+    if (free_cpus + victims < need) {
+      pthread_mutex_unlock(&ready_mutex);
+      return NULL;
+    }
+  }
+
+  /* take the whole group off its list */
+  while (n < need) {
+    member[n] = pcb_list_pop(&g->ready);
+    gang_starting[member[n]->pid] = 1;
+    n++;
+  }
+  g->ready_count = 0;
+  gang_update(g);
+  g->outstanding = need;
+  g->first_tick = g->last_tick = 0;
+  g->split = 0;
+  gang_dispatches++;
+
+  /* hand the members out: this CPU, then idle CPUs, then the victims */
+  n = 0;
+  if (self >= 0) mine = member[n++];
+  while (n < need - victims && (claimed = park_claim()) >= 0) {
+    handoff[claimed] = member[n++];
+    park_wake(claimed);
+  }
+  for (c = 0; c < victims && n < need; c++) handoff[victim[c]] = member[n++];
+  victims = c;
+
+  /* an idle CPU may have been taken since it was counted; those members
+   * go back to wait for the group's next dispatch */
+  while (n < need) {
+    gang_starting[member[n]->pid] = 0;
+    pcb_list_append(&g->ready, member[n++]);
+    g->ready_count++;
+    g->outstanding--;
+    g->split = 1;
+  }
+  gang_update(g);
+
+  pthread_mutex_unlock(&ready_mutex);
+
+  for (c = 0; c < victims; c++) {
+    TRACE(TRACE_SUPERVISOR, TRACE_FORCE_PREEMPT, victim[c],
+          sched_current(victim[c]), ready_count);
+    force_preempt(victim[c]);
+  }
+  return mine;
+}
+
+/*
+ * The dispatch counts as co-scheduled once every member has started on the
+ * same tick
+ */
+extern void gang_started(pcb_t *proc) {
+  gang_t *g = &gangs[proc->group];
+  unsigned int now;
+
+  if (!gang_starting[proc->pid]) return;
+
+  now = getSimulatorTime();
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  gang_starting[proc->pid] = 0;
+  if (g->first_tick == 0 || now + 1 < g->first_tick) g->first_tick = now + 1;
+  if (now + 1 > g->last_tick) g->last_tick = now + 1;
+  if (--g->outstanding == 0 && !g->split && g->first_tick == g->last_tick)
+    gang_coscheduled++;
+  pthread_mutex_unlock(&ready_mutex);
+}
+
+extern void gang_terminated(pcb_t *proc) {
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  gangs[proc->group].live--;
+  gang_update(&gangs[proc->group]);
+  pthread_mutex_unlock(&ready_mutex);
+}
+
+extern void gang_restore(pcb_t *proc) {
+  if (proc->state != PROCESS_NEW && proc->state != PROCESS_TERMINATED)
+    gangs[proc->group].live++;
+}
+
+extern unsigned int gang_save(pcb_t **ready) {
+  unsigned int count = 0, n;
+  pcb_t *proc;
+
+  for (n = 1; n <= group_count; n++) {
+    for (proc = gangs[n].ready.head; proc != NULL; proc = proc->next)
+      ready[count++] = proc;
+  }
+  return count;
+}
+
+/*
+ * gang_update starts or stops a group waiting, when its ready or live
+ * members change.  ready_mutex must be held
+ */
+static void gang_update(gang_t *g) {
+  int ready = g->live > 0 && g->ready_count == g->live;
+
+  if (ready && !g->waiting) {
+    gang_account();
+    g->waiting = ++gang_seq;
+    gang_waiting++;
+  } else if (!ready && g->waiting) {
+    gang_account();
+    g->waiting = 0;
+    gang_waiting--;
+  }
+}
+
+/*
+ * gang_next returns the group that has waited longest of those that fit in
+ * the given number of CPUs, or NULL.  ready_mutex must be held
+ */
+static gang_t *gang_next(unsigned int free_cpus) {
+  gang_t *next = NULL;
+  unsigned int n;
+
+  if (gang_waiting == 0) return NULL;
+  for (n = 1; n <= group_count; n++) {
+    if (gangs[n].waiting && gangs[n].ready_count <= free_cpus &&
+        (next == NULL || gangs[n].waiting < next->waiting))
+      next = &gangs[n];
+  }
+  return next;
+}
+
+/*
+ * gang_account adds up the idle CPU time while a group waits, before
+ * either changes.  ready_mutex must be held
+ */
+static void gang_account(void) {
+  unsigned int now;
+
+  if (!gang) return;
+  now = getSimulatorTime();
+  if (gang_waiting > 0) gang_idle_ticks += (now - gang_since) * idle_cpus;
+  gang_since = now;
+}
+
+/* The idle CPUs may still be parking, so the account is taken under lock */
+static void gang_report(void) {
+  pthread_mutex_lock(&ready_mutex);
+  gang_account();
+  printf("Gang dispatches: %u, co-scheduled in one tick: %u (%.1f%%)\n",
+         gang_dispatches, gang_coscheduled,
+         gang_dispatches ? 100.0 * gang_coscheduled / gang_dispatches : 0.0);
+  printf("Idle CPU time while a group waited: %.1f s\n",
+         (float)gang_idle_ticks / 10.0);
+  pthread_mutex_unlock(&ready_mutex);
+}
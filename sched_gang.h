@@ -0,0 +1,131 @@
+/*
+ * sched_gang.h
+ * Multithreaded OS Simulation
+ *
+ * Gang scheduling (-g).  The processes of a group are kept on the group's
+ * own list rather than in the policy's ready queue.  Once every live member
+ * of a group is ready, the group waits to be dispatched: all its members
+ * are started on free CPUs at once, or none are.  The policy still orders
+ * the ungrouped processes, and groups with more members than there are
+ * CPUs, which could never all run at once.
+ *
+ * A CPU thread in schedule() dispatches a group onto itself and idle CPUs
+ * only.  wake_up_batch(), which runs on the supervisor, also frees CPUs
+ * running ungrouped processes with force_preempt().  A CPU being given a
+ * member finds it in its handoff slot, and takes it with gang_take().
+ *
+ * The core in student.c calls these with ready_mutex held where it says so,
+ * and only once gang_init() has run, except for gang_idle() and
+ * gang_member(), which may be called either way.
+ */
+
+#ifndef __SCHED_GANG_H__
+#define __SCHED_GANG_H__
+
+#include "os-sim.h"
+#include "sched.h"
+
+/*
+ * A process group, when gang scheduling.  Its ready members wait on its own
+ * list, and ready_mutex protects it.
+ *
+ *   size : the number of processes in the group.
+ *
+ *   live : the members that have been created and not yet terminated.
+ *
+ *   waiting : 0, or once every live member is ready, a sequence number that
+ *        orders the waiting groups oldest first.
+ *
+ *   outstanding, first_tick, last_tick, split : for the last dispatch, the
+ *        members yet to be switched in, the first and last ticks (plus one)
+ *        they were switched in on, and whether some were left behind.
+ */
+typedef struct {
+  pcb_list_t ready;
+  unsigned int size;
+  unsigned int live;
+  unsigned int ready_count;
+  unsigned int waiting;
+  unsigned int outstanding;
+  unsigned int first_tick;
+  unsigned int last_tick;
+  int split;
+} gang_t;
+
+/* Set by -g */
+extern int gang;
+
+/*
+ * gang_init() sizes the groups of the processes created, and prints the
+ * gang statistics at exit.
+ */
+extern void gang_init(void);
+
+/*
+ * gang_member() returns whether a process is gang scheduled: it is in a
+ * group of more than one process, and there are enough CPUs to run them all.
+ */
+extern int gang_member(pcb_t *proc);
+
+/*
+ * gang_idle() counts a CPU parking (1) or waking up again (-1).  ready_mutex
+ * must be held.
+ */
+extern void gang_idle(int delta);
+
+/*
+ * gang_handed() returns whether a member has been handed to a CPU, and
+ * gang_ready() whether a waiting group fits on the idle CPUs, counting the
+ * calling CPU as one of them if it hasn't parked yet.  ready_mutex must be
+ * held.
+ */
+extern int gang_handed(unsigned int cpu_id);
+extern int gang_ready(int parked);
+
+/*
+ * gang_enqueue() puts a ready member on its group's list, and returns
+ * whether to wake a CPU for it: only if the idle CPUs can start a group.
+ * ready_mutex must be held.
+ */
+extern int gang_enqueue(pcb_t *proc);
+
+/*
+ * gang_take() returns the member handed to a CPU, or else the member it is
+ * to run of the group it starts, or NULL.
+ */
+extern pcb_t *gang_take(unsigned int cpu_id);
+
+/*
+ * gang_dispatch() starts the group that has waited longest, if there are
+ * CPUs enough for all its members.  The CPUs are the calling CPU (self, or
+ * -1 from the supervisor), the idle CPUs, and if can_preempt is set, the
+ * CPUs running ungrouped processes.  It returns the member for self to run,
+ * or NULL if no group was started.
+ */
+extern pcb_t *gang_dispatch(int self, int can_preempt);
+
+/*
+ * gang_started() is called once a process has been switched in, and
+ * records the tick for the process's group if it was just dispatched.
+ */
+extern void gang_started(pcb_t *proc);
+
+/*
+ * gang_terminated() takes a terminated member out of its group, the rest
+ * of which may now be all that is left, and ready.
+ */
+extern void gang_terminated(pcb_t *proc);
+
+/*
+ * gang_restore() counts a member restored from a checkpoint as live, if it
+ * was created and has not terminated.
+ */
+extern void gang_restore(pcb_t *proc);
+
+/*
+ * gang_save() copies the members waiting on their groups' lists into
+ * ready[], and returns how many there are.  ready_mutex must be held.
+ */
+extern unsigned int gang_save(pcb_t **ready);
+
+#endif /* __SCHED_GANG_H__ */
@@ -0,0 +1,78 @@
+/*
+ * sched_mlfq.c
+ * Multithreaded OS Simulation
+ *
+ * Multi-level feedback queue scheduling.  There are SCHED_LEVELS round-robin
+ * queues; a process's priority field (1 = highest) says which one it is on.
+ * Processes on higher queues always run first.  A process that uses up its
+ * time slice drops a level, and a process that has waited more than
+ * max_wait_time ticks on its queue moves up a level.
+ */
+
+#include <stddef.h>
+
+#include "sched.h"
+
+/* Queue index of a process, clamping priorities outside 1..SCHED_LEVELS */
+static unsigned int mlfq_level(pcb_t *proc) {
+  if (proc->priority < 1) proc->priority = 1;
+  if (proc->priority > SCHED_LEVELS) proc->priority = SCHED_LEVELS;
+  return proc->priority - 1;
+}
+
+static void mlfq_enqueue(ready_queue_t *rq, pcb_t *proc) {
+  pcb_list_append(&rq->level[mlfq_level(proc)], proc);
+  proc->time_added = getSimulatorTime();
+}
+
+// gets the next process by first checking the level 1 Q, and so on...
+static pcb_t *mlfq_dequeue(ready_queue_t *rq) {
+  int level;
+
+  for (level = 0; level < SCHED_LEVELS; level++) {
+    if (rq->level[level].head != NULL) return pcb_list_pop(&rq->level[level]);
+  }
+  return NULL;
+}
+
+static void mlfq_on_preempt(pcb_t *proc) {
+  if (proc->priority < SCHED_LEVELS) proc->priority++;
+}
+
+/*
+ * Ages the lower queues: a process that has waited longer than
+ * max_wait_time moves up one level and starts waiting afresh there.
+ */
+static void mlfq_on_tick(ready_queue_t *rq, unsigned int now) {
+  pcb_t *prev, *proc, *next;
+  int level;
+
+  for (level = 1; level < SCHED_LEVELS; level++) {
+    prev = NULL;
+    for (proc = rq->level[level].head; proc != NULL; proc = next) {
+      next = proc->next;
+      if (now - proc->time_added > max_wait_time) {
+        pcb_list_remove(&rq->level[level], prev, proc);
+        pcb_list_append(&rq->level[level - 1], proc);
+        proc->priority = level;
+        proc->time_added = now;
+      } else {
+        prev = proc;
+      }
+    }
+  }
+}
+
+/* -T may retune the time slice as the CPUs run */
+static int mlfq_slice_for(pcb_t *proc) {
+  return __atomic_load_n(&time_slice, __ATOMIC_RELAXED);
+}
+
+const sched_ops_t sched_mlfq = {
+    .name = "mlfq",
+    .enqueue = mlfq_enqueue,
+    .dequeue = mlfq_dequeue,
+    .on_preempt = mlfq_on_preempt,
+    .on_tick = mlfq_on_tick,
+    .slice_for = mlfq_slice_for,
+};
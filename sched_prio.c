@@ -0,0 +1,161 @@
+/*
+ * sched_prio.c
+ * Multithreaded OS Simulation
+ *
+ * Static priority scheduling: the ready process with the highest
+ * static_priority runs first, and a process that wakes up preempts the CPU
+ * running the lowest priority process if that process has a lower priority
+ * than it.
+ *
+ * With priority inheritance, a process holding a lock that a higher
+ * priority process is blocked on runs at the blocked process's priority,
+ * kept in priority, until it releases the lock.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "sched.h"
+
+/* The priority a process runs at: its own, or one it has inherited */
+static unsigned int prio_of(pcb_t *proc) {
+  return proc->priority > proc->static_priority ? proc->priority
+                                                : proc->static_priority;
+}
+
+/*
+ * The ready queue is kept sorted by priority, highest first.  Processes of
+ * equal priority keep the order in which they became ready.
+ */
+static void prio_enqueue(ready_queue_t *rq, pcb_t *proc) {
+  pcb_list_t *list = &rq->level[0];
+  pcb_t *prev = NULL;
+  pcb_t *pos = list->head;
+
+  while (pos != NULL && prio_of(pos) >= prio_of(proc)) {
+    prev = pos;
+    pos = pos->next;
+  }
+
+  if (pos == NULL) {
+    pcb_list_append(list, proc);
+  } else {
+    proc->next = pos;
+    if (prev == NULL) {
+      list->head = proc;
+    } else {
+      prev->next = proc;
+    }
+  }
+}
+
+static pcb_t *prio_dequeue(ready_queue_t *rq) {
+  return pcb_list_pop(&rq->level[0]);
+}
+
+/*
+ * If any CPU is idle the process will simply be picked up from the ready
+ * queue, so nothing needs to be preempted.  Otherwise preempt the CPU
+ * running the lowest priority process, if it is lower than this one by at
+ * least preempt_threshold.
+ */
+static int prio_on_wake(pcb_t *proc) {
+  unsigned int lowest_priority = 0;
+  int lowest_cpu = -1;
+  pcb_t *running;
+  unsigned int id, cpus = sched_cpu_count();
+
+  for (id = 0; id < cpus; id++) {
+    running = sched_current(id);
+    if (running == NULL) return -1;
+
+    if (lowest_cpu < 0 || prio_of(running) < lowest_priority) {
+      lowest_priority = prio_of(running);
+      lowest_cpu = (int)id;
+    }
+  }
+
+  if (lowest_priority + preempt_threshold <= prio_of(proc)) return lowest_cpu;
+  return -1;
+}
+
+/* A priority and the index of the process or CPU it belongs to */
+typedef struct {
+  int prio;
+  unsigned int index;
+} prio_rank_t;
+
+/* Orders by priority, lowest first, then by index */
+static int compare_rank(const void *a, const void *b) {
+  const prio_rank_t *x = a, *y = b;
+
+  if (x->prio != y->prio) return x->prio < y->prio ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/*
+ * For a batch, each idle CPU is left to pick up one process.  The processes
+ * left over, highest priority first, each preempt the CPU running the
+ * lowest priority process not already picked, if it is lower than theirs
+ * by at least preempt_threshold.
+ * For one process this is prio_on_wake().
+ */
+static void prio_on_wake_batch(pcb_t **procs, unsigned int count,
+                               int *victims) {
+  unsigned int cpus = sched_cpu_count(), idle = 0, busy = 0, id, n, next;
+  prio_rank_t running[cpus], batch[count];
+  pcb_t *proc;
+
+  /*
+   * The CPUs not idle, lowest priority first.  Once there are idle CPUs
+   * enough for the whole batch, nothing is preempted.
+   */
+  for (n = 0; n < count; n++) victims[n] = -1;
+  for (id = 0; id < cpus; id++) {
+    proc = sched_current(id);
+    if (proc == NULL) {
+      if (++idle == count) return;
+      continue;
+    }
+    running[busy].prio = (int)prio_of(proc);
+    running[busy++].index = id;
+  }
+  qsort(running, busy, sizeof(prio_rank_t), compare_rank);
+
+  /*
+   * The batch, highest priority first: the priorities are negated so that
+   * those of equal priority keep their order.  Each preempts the next CPU in
+   * running[] until one is not low enough, when neither are the rest.
+   */
+  for (n = 0; n < count; n++) {
+    batch[n].prio = -(int)prio_of(procs[n]);
+    batch[n].index = n;
+  }
+  qsort(batch, count, sizeof(prio_rank_t), compare_rank);
+
+  for (n = idle, next = 0; n < count && next < busy; n++, next++) {
+    if (running[next].prio + (int)preempt_threshold > -batch[n].prio) break;
+    victims[batch[n].index] = (int)running[next].index;
+  }
+}
+
+static int prio_slice_for(pcb_t *proc) { return -1; }
+
+static int prio_on_block(pcb_t *waiter, pcb_t *holder) {
+  if (prio_of(holder) >= prio_of(waiter)) return 0;
+  holder->priority = prio_of(waiter);
+  return 1;
+}
+
+static void prio_on_unlock(pcb_t *holder) { holder->priority = 0; }
+
+const sched_ops_t sched_prio = {
+    .name = "priority",
+    .enqueue = prio_enqueue,
+    .dequeue = prio_dequeue,
+    .on_wake = prio_on_wake,
+    .on_wake_batch = prio_on_wake_batch,
+    .slice_for = prio_slice_for,
+    .on_block = prio_on_block,
+    .on_unlock = prio_on_unlock,
+};
@@ -0,0 +1,31 @@
+/*
+ * sched_rr.c
+ * Multithreaded OS Simulation
+ *
+ * Round-robin scheduling: FIFO order, but a process is preempted and goes
+ * to the back of the ready queue once it has run for time_slice ticks.
+ */
+
+#include <stddef.h>
+
+#include "sched.h"
+
+static void rr_enqueue(ready_queue_t *rq, pcb_t *proc) {
+  pcb_list_append(&rq->level[0], proc);
+}
+
+static pcb_t *rr_dequeue(ready_queue_t *rq) {
+  return pcb_list_pop(&rq->level[0]);
+}
+
+/* -T may retune the time slice as the CPUs run */
+static int rr_slice_for(pcb_t *proc) {
+  return __atomic_load_n(&time_slice, __ATOMIC_RELAXED);
+}
+
+const sched_ops_t sched_rr = {
+    .name = "rr",
+    .enqueue = rr_enqueue,
+    .dequeue = rr_dequeue,
+    .slice_for = rr_slice_for,
+};
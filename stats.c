@@ -0,0 +1,107 @@
+/*
+ * stats.c
+ * Multithreaded OS Simulation
+ *
+ * The shared memory stats page and its seqlock.  See stats.h for the
+ * interface.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+extern stats_page_t *stats_create(const char *name, unsigned int cpu_count) {
+  stats_page_t *page;
+  int fd;
+
+  /* A reader still attached to the old page keeps it, and sees it finished */
+  if (shm_unlink(name) != 0 && errno != ENOENT) {
+    perror(name);
+    return NULL;
+  }
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(stats_page_t)) != 0) {
+    perror(name);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  page = mmap(NULL, sizeof(stats_page_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+              fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    perror(name);
+    return NULL;
+  }
+
+  /* The new object is zero filled, so seq starts even */
+  page->magic = STATS_MAGIC;
+  page->version = STATS_VERSION;
+  page->cpu_count = cpu_count;
+  return page;
+}
+
+extern const stats_page_t *stats_attach(const char *name) {
+  const stats_page_t *page;
+  struct stat st;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(name);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  if ((size_t)st.st_size < sizeof(stats_page_t)) {
+    fprintf(stderr, "%s: not a version %d stats page\n", name, STATS_VERSION);
+    close(fd);
+    return NULL;
+  }
+  page = mmap(NULL, sizeof(stats_page_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    perror(name);
+    return NULL;
+  }
+  if (page->magic != STATS_MAGIC || page->version != STATS_VERSION) {
+    fprintf(stderr, "%s: not a version %d stats page\n", name, STATS_VERSION);
+    munmap((void *)page, sizeof(stats_page_t));
+    return NULL;
+  }
+  return page;
+}
+
+/*
+ * The writer's increment to odd is an acquire, so the page's stores can't
+ * move above it, and its increment to even a release, so they can't move
+ * below it.  The reader copies the page with acquire loads for the same
+ * reason: the second load of seq can't move above any of them.  The page
+ * is nothing but unsigned ints, so it is copied a word at a time.
+ */
+extern void stats_begin(stats_page_t *page) {
+  __atomic_fetch_add(&page->seq, 1, __ATOMIC_ACQ_REL);
+}
+
+extern void stats_end(stats_page_t *page) {
+  __atomic_fetch_add(&page->seq, 1, __ATOMIC_RELEASE);
+}
+
+extern void stats_read(const stats_page_t *page, stats_page_t *copy) {
+  const unsigned int *from = (const unsigned int *)page;
+  unsigned int *to = (unsigned int *)copy, seq, n;
+
+  while (1) {
+    seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+    if (seq % 2 == 0) {
+      for (n = 0; n < sizeof(stats_page_t) / sizeof(unsigned int); n++)
+        to[n] = __atomic_load_n(&from[n], __ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+    sched_yield();
+  }
+}
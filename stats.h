@@ -0,0 +1,97 @@
+/*
+ * stats.h
+ * Multithreaded OS Simulation
+ *
+ * A page of live counters in POSIX shared memory.
+ *
+ * With "-S <name>" the supervisor copies its counters into a shared memory
+ * object of that name at the start of every tick, where another process,
+ * such as os-sim-top, can poll them while the simulation runs.  The page
+ * holds only counts, never pointers, so it reads the same in any process.
+ *
+ * There is one writer, the supervisor, and any number of readers, which
+ * never block it.  The page is guarded by a seqlock: the writer makes seq
+ * odd, updates the page and makes seq even again, and a reader copies the
+ * page and keeps the copy only if seq was the same even number before and
+ * after.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "sched.h"
+
+#define STATS_MAGIC 0x5453534fu /* "OSST" */
+#define STATS_VERSION 1
+
+/* The CPUs the page has room for; with more, it shows the first of them */
+#define STATS_MAX_CPUS 16
+
+/* Stored in cpu_current[] for an idle CPU */
+#define STATS_IDLE 0xffffffffu
+
+/*
+ * The page.
+ *
+ *   seq : the seqlock's sequence number, odd while the page is written.
+ *
+ *   finished : set once the simulator has exited.
+ *
+ *   tick : the simulator tick the counters were taken at.
+ *
+ *   state_count : the number of processes in each process_state_t.
+ *
+ *   ready_level : the number of processes on each level of the ready
+ *        queues, summed over the scheduling domains.
+ *
+ *   cpu_current : the pid of the process each CPU is running, or
+ *        STATS_IDLE.
+ *
+ *   cpu_busy : the ticks each CPU has spent running a process.
+ */
+typedef struct {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int seq;
+  unsigned int finished;
+  unsigned int cpu_count;
+  unsigned int tick;
+  unsigned int processes_created;
+  unsigned int processes_terminated;
+  unsigned int context_switches;
+  unsigned int io_queue_length;
+  unsigned int state_count[PROCESS_STATES];
+  unsigned int ready_level[SCHED_LEVELS];
+  unsigned int cpu_current[STATS_MAX_CPUS];
+  unsigned int cpu_busy[STATS_MAX_CPUS];
+} stats_page_t;
+
+/*
+ * stats_create() replaces the shared memory object called name with a new
+ * page for the given number of CPUs, and maps it for writing.
+ * stats_attach() maps an existing one for reading.  Both return NULL on
+ * error, after printing the reason to stderr.
+ */
+extern stats_page_t *stats_create(const char *name, unsigned int cpu_count);
+extern const stats_page_t *stats_attach(const char *name);
+
+/*
+ * The writer brackets each update of the page with stats_begin() and
+ * stats_end().
+ */
+extern void stats_begin(stats_page_t *page);
+extern void stats_end(stats_page_t *page);
+
+/* stats_read() takes a consistent copy of the page */
+extern void stats_read(const stats_page_t *page, stats_page_t *copy);
+
+/*
+ * simulator_publish_stats() makes the simulator publish its counters to
+ * the page called name; simulator_quiet() stops it printing the Gantt
+ * chart.  Both are implemented in os-sim.c, and must be called before
+ * start_simulator().
+ */
+extern void simulator_publish_stats(const char *name);
+extern void simulator_quiet(void);
+
+#endif /* __STATS_H__ */
@@ -0,0 +1,225 @@
+/*
+ * stream.c
+ * Multithreaded OS Simulation
+ *
+ * The spill file of a streamed workload, and the reader thread that fills
+ * the processes' buffers from it.  See stream.h for the interface.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "os-sim.h"
+#include "process.h"
+#include "stream.h"
+
+/* A chunk, as stored in the spill file and in a buffer */
+typedef struct {
+  long next;
+  unsigned int count;
+  op_t ops[];
+} stream_chunk_t;
+
+/*
+ * A process's stream.  buf[front] holds its pc; filled is set once the
+ * reader has put the chunk after it in the other buffer.
+ */
+typedef struct {
+  long first;
+  stream_chunk_t *buf[2];
+  int front;
+  int filled;
+} stream_t;
+
+int stream_enabled = 0;
+
+static FILE *spill;
+static long spill_end = 0;
+static unsigned int chunk_ops;
+static stream_t *streams;
+
+/* The process's pc before it is created, and after it terminates */
+static const op_t not_created = {OP_CPU, 0};
+static const op_t terminated = {OP_TERMINATE, 0};
+
+/*
+ * The pids whose back buffer the reader is to fill, a ring that each
+ * process is in at most once.  stream_mutex guards it, and every filled.
+ */
+static unsigned int *pending;
+static unsigned int pending_head = 0, pending_count = 0;
+static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t stream_filled = PTHREAD_COND_INITIALIZER;
+
+static unsigned long chunks_written = 0, chunks_read = 0, read_waits = 0;
+static unsigned int streams_open = 0, streams_peak = 0;
+
+static void *stream_reader(void *arg);
+static void stream_report(void);
+
+static size_t chunk_size(unsigned int count) {
+  return offsetof(stream_chunk_t, ops) + sizeof(op_t) * count;
+}
+
+extern int stream_create(unsigned int ops) {
+  spill = tmpfile();
+  if (spill == NULL) {
+    perror("spill file");
+    return -1;
+  }
+  chunk_ops = ops;
+  stream_enabled = 1;
+  atexit(stream_report);
+  return 0;
+}
+
+extern long stream_write(const op_t *ops, unsigned int count, long prev) {
+  stream_chunk_t header = {-1, count};
+  size_t header_size = offsetof(stream_chunk_t, ops);
+  long offset = spill_end;
+
+  assert(count > 0 && count <= chunk_ops);
+  if (pwrite(fileno(spill), &header, header_size, offset) !=
+          (ssize_t)header_size ||
+      pwrite(fileno(spill), ops, sizeof(op_t) * count,
+             offset + header_size) != (ssize_t)(sizeof(op_t) * count) ||
+      (prev >= 0 && pwrite(fileno(spill), &offset, sizeof(offset), prev) !=
+                        (ssize_t)sizeof(offset))) {
+    perror("spill file");
+    exit(-1);
+  }
+  spill_end += chunk_size(count);
+  chunks_written++;
+  return offset;
+}
+
+extern void stream_attach(pcb_t *pcb, long first) {
+  pthread_t reader;
+
+  if (streams == NULL) {
+    streams = calloc(process_count, sizeof(stream_t));
+    pending = malloc(sizeof(unsigned int) * process_count);
+    assert(streams != NULL && pending != NULL);
+    if (pthread_create(&reader, NULL, stream_reader, NULL) != 0) {
+      perror("pthread_create");
+      exit(-1);
+    }
+    pthread_detach(reader);
+  }
+  streams[pcb->pid].first = first;
+  pcb->pc = &not_created;
+  pcb->remaining = 0;
+}
+
+static void read_chunk(stream_chunk_t *chunk, long offset) {
+  ssize_t got = pread(fileno(spill), chunk, chunk_size(chunk_ops), offset);
+
+  if (got < (ssize_t)offsetof(stream_chunk_t, ops) ||
+      got < (ssize_t)chunk_size(chunk->count)) {
+    perror("spill file");
+    exit(-1);
+  }
+}
+
+/* Queues the read of the chunk after the front one, if there is one */
+static void request(unsigned int pid) {
+  stream_t *s = &streams[pid];
+
+  s->filled = 0;
+  if (s->buf[s->front]->next < 0) return;
+  pending[(pending_head + pending_count) % process_count] = pid;
+  pending_count++;
+  pthread_cond_signal(&stream_work);
+}
+
+static void *stream_reader(void *arg) {
+  stream_chunk_t *back;
+  unsigned int pid;
+  long offset;
+
+  while (1) {
+    pthread_mutex_lock(&stream_mutex);
+    while (pending_count == 0) pthread_cond_wait(&stream_work, &stream_mutex);
+    pid = pending[pending_head];
+    pending_head = (pending_head + 1) % process_count;
+    pending_count--;
+    back = streams[pid].buf[!streams[pid].front];
+    offset = streams[pid].buf[streams[pid].front]->next;
+    pthread_mutex_unlock(&stream_mutex);
+
+    // the front buffer is the process's, and the back one now ours
+    read_chunk(back, offset);
+
+    pthread_mutex_lock(&stream_mutex);
+    chunks_read++;
+    streams[pid].filled = 1;
+    pthread_cond_broadcast(&stream_filled);
+    pthread_mutex_unlock(&stream_mutex);
+  }
+  return NULL;
+}
+
+extern void stream_open(pcb_t *pcb) {
+  stream_t *s = &streams[pcb->pid];
+
+  s->buf[0] = malloc(chunk_size(chunk_ops));
+  s->buf[1] = malloc(chunk_size(chunk_ops));
+  assert(s->buf[0] != NULL && s->buf[1] != NULL);
+  read_chunk(s->buf[0], s->first);
+  pcb->pc = s->buf[0]->ops;
+  pcb->remaining = pcb->pc->time;
+
+  pthread_mutex_lock(&stream_mutex);
+  chunks_read++;
+  s->front = 0;
+  request(pcb->pid);
+  if (++streams_open > streams_peak) streams_peak = streams_open;
+  pthread_mutex_unlock(&stream_mutex);
+}
+
+extern const op_t *stream_next(pcb_t *pcb) {
+  stream_t *s = &streams[pcb->pid];
+  const stream_chunk_t *front = s->buf[s->front];
+
+  if (pcb->pc + 1 < front->ops + front->count) return pcb->pc + 1;
+
+  // a process's last chunk ends with OP_TERMINATE, so there is a next one
+  pthread_mutex_lock(&stream_mutex);
+  if (!s->filled) {
+    read_waits++;
+    while (!s->filled) pthread_cond_wait(&stream_filled, &stream_mutex);
+  }
+  s->front = !s->front;
+  request(pcb->pid);
+  pthread_mutex_unlock(&stream_mutex);
+  return s->buf[s->front]->ops;
+}
+
+extern void stream_close(pcb_t *pcb) {
+  stream_t *s = &streams[pcb->pid];
+
+  // the last chunk has no next, so the reader has nothing of ours
+  pthread_mutex_lock(&stream_mutex);
+  assert(!s->filled && s->buf[s->front]->next < 0);
+  streams_open--;
+  pthread_mutex_unlock(&stream_mutex);
+  free(s->buf[0]);
+  free(s->buf[1]);
+  s->buf[0] = s->buf[1] = NULL;
+  pcb->pc = &terminated;
+}
+
+static void stream_report(void) {
+  if (streams == NULL) return;
+  pthread_mutex_lock(&stream_mutex);
+  printf("Streamed %lu of %lu chunks of up to %u operations, waiting on %lu "
+         "reads;\n  at most %u processes held %lu KB of operations at once\n",
+         chunks_read, chunks_written, chunk_ops, read_waits, streams_peak,
+         (unsigned long)(2 * streams_peak * chunk_size(chunk_ops) / 1024));
+  pthread_mutex_unlock(&stream_mutex);
+}
@@ -0,0 +1,54 @@
+/*
+ * stream.h
+ * Multithreaded OS Simulation
+ *
+ * Streaming a workload's operations from disk.
+ *
+ * With "-B <ops per chunk>" an imported trace (see import.h) is not held in
+ * memory.  The importer writes each task's operations to an unlinked spill
+ * file, in chunks of up to that many operations chained by file offset,
+ * and keeps only the chunk it is filling for each task still alive.
+ *
+ * When the simulator creates a process it gives it two chunk buffers, reads
+ * its first chunk into one and has a reader thread read the next into the
+ * other.  The process's pc runs through the front buffer; when it comes to
+ * the end, the buffers swap, waiting for the read only if it has not
+ * finished, and the reader starts on the chunk after.  When the process
+ * terminates its buffers are freed.  So the operations in memory are at
+ * most two chunks for each process alive, however long the trace.
+ *
+ * A streamed workload can't be checkpointed, as the operations behind a
+ * process's pc are gone.
+ */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "os-sim.h"
+
+/* Set once stream_create() has succeeded */
+extern int stream_enabled;
+
+/*
+ * The importer's side.  stream_create() opens the spill file, for chunks
+ * of at most chunk_ops operations, and returns 0, or -1 after printing the
+ * reason to stderr.  stream_write() appends a chunk of count operations
+ * and returns its offset, linking the chunk at prev to it unless prev is
+ * -1.  stream_attach() gives a process the chain of chunks starting at
+ * first; process_count must be set by then.
+ */
+extern int stream_create(unsigned int chunk_ops);
+extern long stream_write(const op_t *ops, unsigned int count, long prev);
+extern void stream_attach(pcb_t *pcb, long first);
+
+/*
+ * The simulator's side, all called with simulator_mutex held.
+ * stream_open() loads a process's first chunk when it is created,
+ * stream_next() returns the operation after its pc, and stream_close()
+ * frees its buffers when it terminates.
+ */
+extern void stream_open(pcb_t *pcb);
+extern const op_t *stream_next(pcb_t *pcb);
+extern void stream_close(pcb_t *pcb);
+
+#endif /* __STREAM_H__ */
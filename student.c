@@ -16,83 +16,421 @@
 #include <string.h>
 
 #include "os-sim.h"
+#include "process.h"
+#include "cgroup.h"
+#include "checkpoint.h"
+#include "domain.h"
+#include "energy.h"
+#include "import.h"
+#include "park.h"
+#include "prof.h"
+#include "readyq.h"
+#include "replay.h"
+#include "sched.h"
+#include "sched_gang.h"
+#include "stats.h"
 #include "student.h"
+#include "trace.h"
+#include "tune.h"
 
 // Local helper functions
 static void addReadyProcess(pcb_t* proc);
-static pcb_t* getReadyProcess(void);
+static void queueReadyProcess(pcb_t* proc, int domain);
+static int enqueueReady(pcb_t* proc, int* domain, unsigned int* remote);
+static void enqueueLockFree(pcb_t* proc);
+static void wakeReadyCpu(pcb_t* proc, unsigned int domain, unsigned int remote);
+static pcb_t* getReadyProcess(unsigned int cpu_id);
 static void schedule(unsigned int cpu_id);
-static void addMultiLevelProcess(pcb_t* proc);
-static void updatePriorities(void);
-static pcb_t* getMultiLevelProcess(void);
+static void inherit_priority(pcb_t* waiter);
+static void reinherit_priority(pcb_t* proc);
+static int requeue(pcb_t* proc);
+static void inherit_report(void);
+static pcb_t* dequeueReady(ready_queue_t* rq);
 
 /*
- * enum is useful C language construct to associate desriptive words with
- * integer values
- * in this case the variable "alg" is created to be of the given enum type,
- * which allows
- * statements like "if alg == FIFO { ...}", which is much better than "if alg ==
- * 1" where
- * you have to remember what algorithm is meant by "1"...
- * just including it here to introduce you to the idea if you haven't seen it
- * before!
+ * The scheduling policy in use.  Everything that differs between the
+ * algorithms is behind this table of functions (see sched.h), so the
+ * callbacks below never need to check which algorithm was picked.
  */
-typedef enum {
-  FIFO = 0,
-  RoundRobin,
-  StaticPriority,
-  MultiLevel
-} scheduler_alg;
-
-scheduler_alg alg;
+static const sched_ops_t* sched;
 
 // declare other global vars
 int time_slice = -1;
 int cpu_count;
 int max_wait_time;
 
+/* The core state shared with the modules, see student.h */
+pcb_t** current;
+pthread_mutex_t current_mutex;
+ready_queue_t* ready_queue;
+unsigned int domain_count = 1;
+unsigned int ready_count;
+pthread_mutex_t ready_mutex;
+
+/*
+ * What wake_up_batch() works out for each process of a batch: the socket
+ * it is queued on, the remote sockets whose CPUs might pull it over, and
+ * whether to wake an idle CPU for it.  batch_victims[] holds the CPU each
+ * one preempts, or -1.
+ */
+typedef struct {
+  int domain;
+  unsigned int remote;
+  int wake;
+} wake_t;
+
+static wake_t* batch;
+static int* batch_victims;
+
+/*
+ * Lock-free ready queue (-Q).  The FIFO, RoundRobin and StaticPriority
+ * policies order the ready queue by static priority, if at all, and then by
+ * the order the processes became ready, which is the order of a readyq_t
+ * (see readyq.h).  With one of them the ready queue can be a readyq_t, and
+ * queueing a process or taking one off it doesn't hold ready_mutex.  It is
+ * for one socket, and not for gangs, groups, priority inheritance or
+ * packing, which keep more of their state under ready_mutex.
+ */
+static int lockfree = 0;
+static readyq_t lockfree_queue;
+
+/*
+ * Priority inheritance (-i).  A process that blocks on a lock lends its
+ * priority to the holder, if the policy has a notion of priority, and to
+ * the holder of any lock that holder is blocked on in turn.  When a lock
+ * changes hands, the process giving it up and the one taking it keep only
+ * what the processes still blocked on their locks lend them.  It isn't for
+ * -g or -C, whose processes can wait on lists the policy doesn't order.
+ */
+static int inherit = 0;
+static unsigned int inherit_boosts = 0;
+
+/*
+ * With CPU bandwidth groups (-C), the processes scheduler_tick() takes off
+ * the held lists of the groups whose period ended, and the CPUs it
+ * preempts for the groups throttled
+ */
+static pcb_t** cgroup_released;
+static unsigned int* cgroup_victim;
+
+/*
+ * The tick each process was created on, kept for -C and -T.  A process
+ * restored from a checkpoint is counted from tick 0.
+ */
+static unsigned int* arrival_tick = NULL;
+
+static void usage(void);
+
 /*
  * main() parses command line arguments, initializes globals, and starts
  * simulation
  */
 int main(int argc, char* argv[]) {
+  const char* trace_path = NULL;
+  int argi;
+  unsigned int sockets = 1, cores_per_cache = 0, copies = 1;
+  unsigned int jobs = 0, duration = 0;
+  double rate = 0.0;
+  int locks = 0;
+  const char* energy_name = NULL;
+  const char* stats_name = NULL;
+  const char* tune_name = NULL;
+  unsigned int tune_window = 0;
+  const char* import_path = NULL;
+  unsigned int usec_per_tick = 0, chunk_ops = 0;
+  const char* replay_path = NULL;
+  replay_mode_t replay = REPLAY_OFF;
+
   /* Parse command line args - must include num_cpus as first, rest optional
    * Default is to simulate using just FIFO on given num cpus, if 2nd arg given:
    * if -r, use round robin to schedule (must be 3rd arg of time_slice)
    * if -p, use static priority to schedule
+   * Options that don't pick the scheduler come after the scheduler's args:
+   * if -t, write a Chrome trace of scheduler events to the given file
+   * if -w, repeat the built-in workload the given number of times
+   * if -s, use the policy with the given name, or load it from a .so file;
+   *   the built-in rr and mlfq still take their parameters from -r and -m
+   * if -c, write a checkpoint to the given file at the given tick and stop
+   * if -l, start from the checkpoint in the given file
+   * if -g, gang schedule the process groups
+   * if -n, split the CPUs into the given sockets and caches of given size
+   * if -M, set the migration penalties across caches and across sockets
+   * if -b, set the imbalance between sockets that moves processes
+   * if -L, run the workload whose processes take locks
+   * if -i, turn on priority inheritance for processes blocked on locks
+   * if -a, run an open system of the given number of jobs arriving at the
+   *   given rate per second
+   * if -d, stop an open system after the given number of ticks
+   * if -E, model the CPUs' energy, and race to idle or pack the work
+   * if -S, publish live stats to the given shared memory object
+   * if -q, don't print the Gantt chart
+   * if -C, add a CPU bandwidth group of the processes whose names start with
+   *   the given prefix, with the given shares and quota per period in ms
+   * if -T, tune the time slice (and aging) over windows of the given number
+   *   of ticks, on mean READY time, p99 turnaround or context switches
+   * if -I, run the tasks in the given Linux sched_switch trace, at the given
+   *   microseconds per tick, instead of the built-in workload
+   * if -B, stream the imported workload from disk in chunks of the given
+   *   number of operations
+   * if -R, record the order the threads ran in to the given file, or replay
+   *   the order recorded there
+   * if -Q, keep the ready queue in a lock-free skip list
+   * if -K, preempt for a waking process only if its priority is higher than
+   *   the running process's by at least the given gap
    */
-  if (argc == 2) {
-    alg = FIFO;
-    printf("running with basic FIFO\n");
-  } else if (argc > 2 && strcmp(argv[2], "-r") == 0 && argc > 3) {
-    alg = RoundRobin;
+  if (argc < 2) {
+    usage();
+    return -1;
+  }
+  if (argc > 2 && strcmp(argv[2], "-r") == 0 && argc > 3) {
+    sched = &sched_rr;
     time_slice = atoi(argv[3]);
-    printf("running with round robin, time slice = %d\n", time_slice);
+    argi = 4;
   } else if (argc > 2 && strcmp(argv[2], "-p") == 0) {
-    alg = StaticPriority;
-    printf("running with static priority\n");
+    sched = &sched_prio;
+    argi = 3;
   } else if (argc > 2 && strcmp(argv[2], "-m") == 0 && argc > 4) {
-    alg = MultiLevel;
+    sched = &sched_mlfq;
     time_slice = atoi(argv[3]);
     max_wait_time = atoi(argv[4]);
+    argi = 5;
+  } else {
+    sched = &sched_fifo;
+    argi = 2;
+  }
+
+  for (; argi < argc; argi++) {
+    if (strcmp(argv[argi], "-t") == 0 && argi + 1 < argc) {
+      trace_path = argv[++argi];
+    } else if (strcmp(argv[argi], "-w") == 0 && argi + 1 < argc &&
+               atoi(argv[argi + 1]) > 0) {
+      copies = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "-s") == 0 && argi + 1 < argc) {
+      sched = sched_lookup(argv[++argi]);
+      if (sched == NULL) {
+        fprintf(stderr, "unknown scheduler %s\n", argv[argi]);
+        return -1;
+      }
+      /* The built-in rr and mlfq take their parameters from -r and -m */
+      if (sched == &sched_rr && time_slice < 1) {
+        fprintf(stderr, "-s rr needs a time slice: -r <time slice> -s rr\n");
+        return -1;
+      }
+      if (sched == &sched_mlfq && (time_slice < 1 || max_wait_time < 1)) {
+        fprintf(stderr, "-s mlfq needs a time slice and max wait time: "
+                        "-m <time slice> <max wait time> -s mlfq\n");
+        return -1;
+      }
+    } else if (strcmp(argv[argi], "-c") == 0 && argi + 2 < argc) {
+      simulator_checkpoint_at(atoi(argv[argi + 1]), argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-l") == 0 && argi + 1 < argc) {
+      simulator_restore_from(argv[++argi]);
+    } else if (strcmp(argv[argi], "-g") == 0) {
+      gang = 1;
+    } else if (strcmp(argv[argi], "-n") == 0 && argi + 2 < argc &&
+               atoi(argv[argi + 1]) > 0 &&
+               atoi(argv[argi + 1]) <= DOMAIN_MAX_SOCKETS &&
+               atoi(argv[argi + 2]) > 0) {
+      sockets = atoi(argv[argi + 1]);
+      cores_per_cache = atoi(argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-M") == 0 && argi + 2 < argc) {
+      topology.cache_penalty = atoi(argv[argi + 1]);
+      topology.socket_penalty = atoi(argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-b") == 0 && argi + 1 < argc &&
+               atoi(argv[argi + 1]) >= 100) {
+      imbalance_pct = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "-L") == 0) {
+      locks = 1;
+    } else if (strcmp(argv[argi], "-i") == 0) {
+      inherit = 1;
+    } else if (strcmp(argv[argi], "-a") == 0 && argi + 2 < argc &&
+               atof(argv[argi + 1]) > 0 && atoi(argv[argi + 2]) > 0) {
+      rate = atof(argv[argi + 1]);
+      jobs = atoi(argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-d") == 0 && argi + 1 < argc &&
+               atoi(argv[argi + 1]) > 0) {
+      duration = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "-E") == 0 && argi + 1 < argc &&
+               (strcmp(argv[argi + 1], "race") == 0 ||
+                strcmp(argv[argi + 1], "pack") == 0)) {
+      energy_name = argv[++argi];
+      energy = strcmp(energy_name, "race") == 0 ? ENERGY_RACE : ENERGY_PACK;
+    } else if (strcmp(argv[argi], "-S") == 0 && argi + 1 < argc) {
+      stats_name = argv[++argi];
+    } else if (strcmp(argv[argi], "-q") == 0) {
+      simulator_quiet();
+    } else if (strcmp(argv[argi], "-C") == 0 && argi + 4 < argc &&
+               cgroup_count < CGROUP_MAX && atoi(argv[argi + 2]) > 0 &&
+               atoi(argv[argi + 3]) >= 0 && atoi(argv[argi + 3]) % 100 == 0 &&
+               atoi(argv[argi + 4]) >= 100 && atoi(argv[argi + 4]) % 100 == 0) {
+      cgroup_add(argv[argi + 1], atoi(argv[argi + 2]), atoi(argv[argi + 3]),
+                 atoi(argv[argi + 4]));
+      argi += 4;
+    } else if (strcmp(argv[argi], "-T") == 0 && argi + 2 < argc &&
+               atoi(argv[argi + 2]) > 0 &&
+               (strcmp(argv[argi + 1], "ready") == 0 ||
+                strcmp(argv[argi + 1], "p99") == 0 ||
+                strcmp(argv[argi + 1], "switches") == 0)) {
+      tune_name = argv[argi + 1];
+      tune = strcmp(tune_name, "ready") == 0
+                 ? TUNE_READY
+                 : strcmp(tune_name, "p99") == 0 ? TUNE_P99 : TUNE_SWITCHES;
+      tune_window = atoi(argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-I") == 0 && argi + 2 < argc &&
+               atoi(argv[argi + 2]) > 0) {
+      import_path = argv[argi + 1];
+      usec_per_tick = atoi(argv[argi + 2]);
+      argi += 2;
+    } else if (strcmp(argv[argi], "-B") == 0 && argi + 1 < argc &&
+               atoi(argv[argi + 1]) >= 2) {
+      chunk_ops = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "-R") == 0 && argi + 2 < argc &&
+               (strcmp(argv[argi + 1], "record") == 0 ||
+                strcmp(argv[argi + 1], "replay") == 0)) {
+      replay = strcmp(argv[argi + 1], "record") == 0 ? REPLAY_RECORD
+                                                     : REPLAY_REPLAY;
+      replay_path = argv[argi + 2];
+      argi += 2;
+    } else if (strcmp(argv[argi], "-Q") == 0) {
+      lockfree = 1;
+    } else if (strcmp(argv[argi], "-K") == 0 && argi + 1 < argc &&
+               atoi(argv[argi + 1]) >= 1) {
+      preempt_threshold = atoi(argv[++argi]);
+    } else {
+      usage();
+      return -1;
+    }
+  }
+
+  if (sched == &sched_fifo) {
+    printf("running with basic FIFO\n");
+  } else if (sched == &sched_rr) {
+    printf("running with round robin, time slice = %d\n", time_slice);
+  } else if (sched == &sched_prio) {
+    printf("running with static priority\n");
+  } else if (sched == &sched_mlfq) {
     printf("running with multi-level feedback queues\n");
   } else {
-    fprintf(stderr,
-            "Usage: ./os-sim <# CPUs> [ -r <time slice> | -p | -m <time slice> "
-            "<max wait time>]\n"
-            "    Default : FIFO Scheduler\n"
-            "					-m : Multi level Feedback "
-            "Queue "
-            "Scheduler\n"
-            "         -r : Round-Robin Scheduler (must also give time slice)\n"
-            "         -p : Static Priority Scheduler\n\n");
+    printf("running with %s\n", sched->name);
+  }
+  if (chunk_ops > 0 && import_path == NULL) {
+    usage();
+    return -1;
+  }
+  if (import_path != NULL && (copies != 1 || locks || gang)) {
+    fprintf(stderr, "an imported workload can't be repeated, take locks or "
+                    "be gang scheduled\n");
+    return -1;
+  }
+  if (gang) printf("gang scheduling process groups\n");
+  if (locks) printf("processes take locks\n");
+  if (jobs) {
+    printf("open system of %u jobs arriving at %.2f per second\n", jobs,
+           rate);
+    /* Enough copies of the workload for every job */
+    copies = (jobs + 7) / 8;
+    simulator_open_loop(rate, jobs, duration);
+  } else if (duration) {
+    usage();
+    return -1;
+  }
+  if (energy != ENERGY_OFF) energy_init();
+  /* requeue() only moves processes on the policy's ready queue */
+  if (inherit && (gang || cgroup_count > 0)) {
+    fprintf(stderr, "priority inheritance can't be used with -g or -C\n");
+    return -1;
+  }
+  if (inherit) {
+    printf("with priority inheritance\n");
+    atexit(inherit_report);
+  }
+  if (stats_name != NULL) {
+    printf("publishing live stats to %s\n", stats_name);
+    simulator_publish_stats(stats_name);
+  }
+  if (cgroup_count > 0 && gang) {
+    fprintf(stderr, "CPU bandwidth groups can't be gang scheduled\n");
     return -1;
   }
+  cgroup_print();
+  if (tune != TUNE_OFF && sched != &sched_rr && sched != &sched_mlfq) {
+    fprintf(stderr, "auto-tuning needs -r or -m\n");
+    return -1;
+  }
+  if (tune != TUNE_OFF)
+    printf("auto-tuning the time slice%s on %s over windows of %u ticks\n",
+           sched == &sched_mlfq ? " and max wait time" : "", tune_name,
+           tune_window);
+  if (lockfree && ((sched != &sched_fifo && sched != &sched_rr &&
+                    sched != &sched_prio) ||
+                   gang || sockets > 1 || cores_per_cache != 0 ||
+                   cgroup_count > 0 || inherit || energy == ENERGY_PACK)) {
+    fprintf(stderr, "the lock-free ready queue needs FIFO, -r or -p, on one "
+                    "socket, without -g, -C, -i or -E pack\n");
+    return -1;
+  }
+  if (lockfree) printf("lock-free ready queue\n");
+  if (preempt_threshold != 1 && sched != &sched_prio) {
+    fprintf(stderr, "-K is for the StaticPriority scheduler, -p\n");
+    return -1;
+  }
+  if (preempt_threshold != 1)
+    printf("preempting for a priority gap of %u or more\n",
+           preempt_threshold);
   fflush(stdout);
 
   /* atoi converts string to integer */
   cpu_count = atoi(argv[1]);
 
+  /* Without -n the CPUs are one socket and share one cache */
+  topology.sockets = sockets;
+  topology.cores_per_socket = cpu_count / sockets;
+  topology.cores_per_cache =
+      cores_per_cache ? cores_per_cache : topology.cores_per_socket;
+  domain_count = sockets;
+  if (sockets > 1 || cores_per_cache != 0) {
+    printf("%u sockets of %u CPUs, %u CPUs to a cache\n", sockets,
+           topology.cores_per_socket, topology.cores_per_cache);
+    atexit(domain_report);
+  }
+
+  if (import_path == NULL)
+    create_processes(copies, locks);
+  else if (import_processes(import_path, usec_per_tick, chunk_ops) != 0)
+    return -1;
+  batch = malloc(sizeof(wake_t) * process_count);
+  batch_victims = malloc(sizeof(int) * process_count);
+  assert(batch != NULL && batch_victims != NULL);
+  if (cgroup_count > 0 || tune != TUNE_OFF) {
+    arrival_tick = calloc(process_count, sizeof(unsigned int));
+    assert(arrival_tick != NULL);
+  }
+  if (cgroup_count > 0) {
+    cgroup_released = malloc(sizeof(pcb_t*) * process_count);
+    cgroup_victim = malloc(sizeof(unsigned int) * cpu_count);
+    assert(cgroup_released != NULL && cgroup_victim != NULL);
+    if (cgroup_init() != 0) return -1;
+  }
+  if (tune != TUNE_OFF)
+    tune_begin(tune_name, tune_window, sched == &sched_mlfq);
+  if (lockfree) readyq_init(&lockfree_queue, process_count);
+
+  if (trace_path != NULL && trace_open(trace_path, cpu_count) != 0) {
+    perror(trace_path);
+    return -1;
+  }
+  if (replay != REPLAY_OFF) {
+    printf("%s the threads' interleaving %s %s\n",
+           replay == REPLAY_RECORD ? "recording" : "replaying",
+           replay == REPLAY_RECORD ? "to" : "from", replay_path);
+    if (replay_open(replay_path, replay, cpu_count) != 0) return -1;
+  }
+
   /* Allocate the current[] array and its mutex */
   current = malloc(sizeof(pcb_t*) * cpu_count);
   int i;
@@ -101,388 +439,673 @@ int main(int argc, char* argv[]) {
   }
   assert(current != NULL);
   pthread_mutex_init(&current_mutex, NULL);
+  if (gang) gang_init();
 
   /* Initialize other necessary synch constructs */
+  ready_queue = calloc(domain_count, sizeof(ready_queue_t));
+  assert(ready_queue != NULL);
   pthread_mutex_init(&ready_mutex, NULL);
-  pthread_cond_init(&ready_empty, NULL);
+  park_init(cpu_count);
 
   /* Start the simulator in the library */
   printf("starting simulator\n");
   fflush(stdout);
-  start_simulator(cpu_count);
+  start_simulator(cpu_count, &topology);
 
   return 0;
 }
 
+static void usage(void) {
+  fprintf(stderr,
+          "Usage: ./os-sim <# CPUs> [ -r <time slice> | -p | -m <time slice> "
+          "<max wait time>] [ -t <trace file> ] [ -w <copies> ]\n"
+          "                [ -s <policy name | policy.so> ] [ -c <tick> "
+          "<checkpoint file> ]\n"
+          "                [ -l <checkpoint file> ] [ -g ] [ -n <sockets> "
+          "<CPUs per cache> ]\n"
+          "                [ -M <cache penalty> <socket penalty> ] [ -b "
+          "<imbalance %%> ] [ -L ] [ -i ]\n"
+          "                [ -a <jobs per second> <jobs> [ -d <ticks> ] ] "
+          "[ -E race | pack ]\n"
+          "                [ -S <shared memory name> ] [ -q ]\n"
+          "                [ -C <name prefix> <shares> <quota ms> <period ms> "
+          "] ...\n"
+          "                [ -T ready | p99 | switches <window ticks> ]\n"
+          "                [ -I <sched trace> <us per tick> [ -B <ops per "
+          "chunk> ] ]\n"
+          "                [ -R record | replay <log file> ] [ -Q ] "
+          "[ -K <priority gap> ]\n"
+          "    Default : FIFO Scheduler\n"
+          "					-m : Multi level Feedback "
+          "Queue "
+          "Scheduler\n"
+          "         -r : Round-Robin Scheduler (must also give time slice)\n"
+          "         -p : Static Priority Scheduler\n"
+          "         -t : write a Chrome trace of scheduler events to a "
+          "file\n"
+          "         -w : repeat the built-in workload of 8 processes <copies> "
+          "times\n"
+          "         -s : use the named scheduler (fifo, rr, priority, mlfq) or "
+          "load one\n"
+          "              from a shared object; rr needs -r, and mlfq -m, "
+          "before it\n"
+          "         -c : write a checkpoint at the given tick and stop\n"
+          "         -l : continue from a checkpoint, with any scheduler\n"
+          "         -g : gang schedule process groups\n"
+          "         -n : split the CPUs into sockets, and caches shared by "
+          "the given\n"
+          "              number of CPUs (up to 32 sockets)\n"
+          "         -M : ticks a process loses moving to another cache, or "
+          "socket\n"
+          "         -b : move processes between sockets when one's load is "
+          "over this\n"
+          "              percentage of the other's (default 125)\n"
+          "         -L : run the workload whose processes take locks\n"
+          "         -i : blocked processes lend their priority to lock "
+          "holders\n"
+          "         -a : run an open system, where the workload's processes "
+          "arrive at\n"
+          "              random at the given rate until <jobs> have "
+          "arrived\n"
+          "         -d : end an open system after <ticks>, even with jobs "
+          "left\n"
+          "         -E : report the energy used, racing to idle at full speed "
+          "or packing\n"
+          "              the work onto fewer, slower CPUs\n"
+          "         -S : publish live stats to a shared memory object, e.g. "
+          "/os-sim, for\n"
+          "              os-sim-top to watch\n"
+          "         -q : don't print the Gantt chart, which allows up to "
+          "1024 CPUs\n"
+          "         -C : put the processes whose names start with the prefix "
+          "in a group with\n"
+          "              the given CPU shares, throttled once it has run for "
+          "its quota in a\n"
+          "              period (0 for no quota); groups nest by prefix, up "
+          "to 8 of them\n"
+          "         -T : with -r or -m, retune the time slice (and max wait "
+          "time) every\n"
+          "              window to cut the mean READY time, the p99 "
+          "turnaround or the\n"
+          "              context switches, and report the values converged "
+          "on\n"
+          "         -I : run the tasks of a perf sched or ftrace sched_switch "
+          "and sched_wakeup\n"
+          "              text trace as processes, with a tick standing for "
+          "the given\n"
+          "              microseconds\n"
+          "         -B : stream the imported operations from disk in chunks, "
+          "keeping two\n"
+          "              chunks in memory for each live process\n"
+          "         -R : run the threads in turns, recording the order they "
+          "ran in to a log,\n"
+          "              or replaying the order a log recorded, to repeat a "
+          "run exactly\n"
+          "         -Q : with FIFO, -r or -p, queue and take ready processes "
+          "without a lock,\n"
+          "              in a lock-free skip list\n"
+          "         -K : with -p, preempt only for a process whose priority "
+          "is higher by\n"
+          "              at least the given gap (1)\n\n");
+}
+
 /*
  * idle() is called by the simulator when the idle process is scheduled.
- * It blocks until a process is added to the ready queue, and then calls
- * schedule() to select the next process to run on the CPU.
- *
- * THIS FUNCTION IS ALREADY COMPLETED - DO NOT MODIFY
+ * It parks the CPU until a process is added to the ready queue, and then
+ * calls schedule() to select the next process to run on the CPU.  Each
+ * process added to the ready queue wakes one idle CPU (see park.h), so a
+ * CPU that is woken but finds the process already taken by another CPU
+ * just parks again.
  */
 extern void idle(unsigned int cpu_id) {
-  pthread_mutex_lock(&ready_mutex);
-  while (head == NULL) {
-    pthread_cond_wait(&ready_empty, &ready_mutex);
+  int ready, parked = 0;
+
+  /* There is work if a process is queued, handed to this CPU, or a group
+   * is waiting that the idle CPUs can run */
+#define IDLE_READY()                                        \
+  ((lockfree ? readyq_count(&lockfree_queue)                 \
+             : ready_queue[cpu_socket(cpu_id)].count) > 0 || \
+   (gang && gang_handed(cpu_id)) ||                          \
+   busiest_domain(cpu_socket(cpu_id), cpu_id) >= 0 ||        \
+   (gang && gang_ready(parked)))
+
+  do {
+    park_mark_idle(cpu_id);
+
+    PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+    ready = IDLE_READY();
+    if (!ready && !parked) {
+      gang_idle(1);
+      parked = 1;
+    }
+    pthread_mutex_unlock(&ready_mutex);
+
+    if (!ready) {
+      park_wait(cpu_id);
+
+      PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+      ready = IDLE_READY();
+      pthread_mutex_unlock(&ready_mutex);
+    }
+  } while (!ready);
+#undef IDLE_READY
+
+  park_unmark_idle(cpu_id);
+  if (parked) {
+    PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+    gang_idle(-1);
+    pthread_mutex_unlock(&ready_mutex);
   }
-  pthread_mutex_unlock(&ready_mutex);
   schedule(cpu_id);
 }
 
 /*
- * schedule() is your CPU scheduler. It currently implements basic FIFO
- * scheduling -
- * 1. calls getReadyProcess to select and remove a runnable process from your
- * ready queue
+ * schedule() is your CPU scheduler.
+ * 1. takes the process handed to this cpu by a gang dispatch, or starts a
+ * waiting group, or calls getReadyProcess to select and remove a runnable
+ * process from your ready queue
  * 2. updates the current array to show this process (or NULL if there was none)
  * as running on the given cpu
  * 3. sets this process state to running (unless its the NULL process)
  * 4. calls context_switch to actually start the chosen process on the given cpu
+ *    with the time slice the policy gives it
  *    - note if proc==NULL the idle process will be run
- *    - note the final arg of -1 means there is no clock interrupt
+ *    - note a time slice of -1 means there is no clock interrupt
  *	context_switch() is prototyped in os-sim.h. Look there for more
  * information.
- * a basic getReadyProcess() is implemented below, look at the comments for
- * info.
- *
- * TO-DO: handle scheduling with a time-slice when necessary
- *
- * THIS FUNCTION IS PARTIALLY COMPLETED - REQUIRES MODIFICATION
  */
 static void schedule(unsigned int cpu_id) {
-  pcb_t* proc = getReadyProcess();
+  pcb_t* proc = NULL;
 
-  pthread_mutex_lock(&current_mutex);
+  if (gang) proc = gang_take(cpu_id);
+  if (proc == NULL) proc = getReadyProcess(cpu_id);
+  if (energy == ENERGY_PACK && proc != NULL) pack_frequency(cpu_id);
+
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
   current[cpu_id] = proc;
   pthread_mutex_unlock(&current_mutex);
 
   if (proc != NULL) {
-    proc->state = PROCESS_RUNNING;
+    set_process_state(proc, PROCESS_RUNNING);
   }
 
-  // FIFO and Static Priority don't use time slices
-  if (alg == FIFO || alg == StaticPriority) {
-    context_switch(cpu_id, proc, -1);
-  } else if (alg == RoundRobin) {
-    context_switch(cpu_id, proc, time_slice);
-  } else if (alg == MultiLevel) {
-    updatePriorities();
-    context_switch(cpu_id, proc, time_slice);
-  }
+  TRACE(cpu_id, TRACE_CONTEXT_SWITCH, cpu_id, proc, ready_count);
+  if (tune == TUNE_SWITCHES) tune_switched();
+
+  context_switch(cpu_id, proc, proc != NULL ? sched->slice_for(proc) : -1);
+
+  if (gang && proc != NULL) gang_started(proc);
 }
 
 /*
  * preempt() is called when a process is preempted due to its timeslice
- * expiring.
- *
- * This function should place the currently running process back in the
- * ready queue, then call schedule() to select a new runnable process.
+ * expiring, or by force_preempt().
  *
- * THIS FUNCTION MUST BE IMPLEMENTED FOR ROUND ROBIN OR PRIORITY SCHEDULING
+ * This function places the currently running process back in the
+ * ready queue, then calls schedule() to select a new runnable process.
  */
 extern void preempt(unsigned int cpu_id) {
-  pthread_mutex_lock(&current_mutex);
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
   pcb_t* proc = current[cpu_id];
   pthread_mutex_unlock(&current_mutex);
 
+  // Let the policy react, e.g. by lowering the process's priority
+  if (sched->on_preempt != NULL) sched->on_preempt(proc);
+
   // Puts the running process on the ready queue
   addReadyProcess(proc);
+  TRACE(cpu_id, TRACE_PREEMPT, cpu_id, proc, ready_count);
   schedule(cpu_id);
 }
 
 /*
  * yield() is called by the simulator when a process performs an I/O request
  * note this is different than the concept of yield in user-level threads!
- * In this context, yield sets the state of the process to waiting (on I/O),
- * then calls schedule() to select a new process to run on this CPU.
+ * or blocks on a lock.
+ * In this context, yield sets the state of the process to waiting (on I/O
+ * or the lock), then calls schedule() to select a new process to run on
+ * this CPU.
  * args: int - id of CPU process wishing to yield is currently running on.
- *
- * THIS FUNCTION IS ALREADY COMPLETED - DO NOT MODIFY
  */
 extern void yield(unsigned int cpu_id) {
+  pcb_t* proc;
+
   // use lock to ensure thread-safe access to current process
-  pthread_mutex_lock(&current_mutex);
-  current[cpu_id]->state = PROCESS_WAITING;
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  proc = current[cpu_id];
+  set_process_state(proc, PROCESS_WAITING);
+  TRACE(cpu_id, TRACE_YIELD, cpu_id, proc, ready_count);
   pthread_mutex_unlock(&current_mutex);
+
+  if (inherit) inherit_priority(proc);
   schedule(cpu_id);
 }
 
 /*
  * terminate() is called by the simulator when a process completes.
- * marks the process as terminated, then calls schedule() to select
+ * marks the process as terminated, hands its turnaround time to the CPU
+ * groups and the p99 auto-tuner, then calls schedule() to select
  * a new process to run on this CPU.
  * args: int - id of CPU process wishing to terminate is currently running on.
- *
- * THIS FUNCTION IS ALREADY COMPLETED - DO NOT MODIFY
  */
 extern void terminate(unsigned int cpu_id) {
+  pcb_t* proc;
+
   // use lock to ensure thread-safe access to current process
-  pthread_mutex_lock(&current_mutex);
-  current[cpu_id]->state = PROCESS_TERMINATED;
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  proc = current[cpu_id];
+  set_process_state(proc, PROCESS_TERMINATED);
+  TRACE(cpu_id, TRACE_TERMINATE, cpu_id, proc, ready_count);
   pthread_mutex_unlock(&current_mutex);
+
+  if (cgroup_count > 0)
+    cgroup_terminated(proc, getSimulatorTime() - arrival_tick[proc->pid]);
+  if (tune == TUNE_P99) tune_terminated(arrival_tick[proc->pid]);
+
+  // the rest of its group may now be all that is left, and ready
+  if (gang_member(proc)) gang_terminated(proc);
   schedule(cpu_id);
 }
 
 /*
- * wake_up() is called for a new process and when an I/O request completes.
- * The current implementation handles basic FIFO scheduling by simply
- * marking the process as READY, and calling addReadyProcess to put it in the
- * ready queue.  No locks are needed to set the process state as its not
- * possible for anyone else to also access it at the same time as wake_up
- *
- * TO-DO: If the scheduling algorithm is static priority, wake_up() may need
- * to preempt the CPU with the lowest priority process to allow it to
- * execute the process which just woke up.  However, if any CPU is
- * currently running idle, or all of the CPUs are running processes
- * with a higher priority than the one which just woke up, wake_up()
- * should not preempt any CPUs. To preempt a process, use force_preempt().
- * Look in os-sim.h for its prototype and parameters.
- *
- * THIS FUNCTION IS PARTIALLY COMPLETED - REQUIRES MODIFICATION
+ * wake_up_batch() is called for the processes woken on the same tick: new
+ * processes, the one whose I/O request completed, and those handed a lock.
+ * The policy decides at once which CPUs to preempt in favour of them, if
+ * any (the static priority policy preempts the CPUs running the lowest
+ * priority processes when no CPU is idle).  They are then all marked READY
+ * and put in the ready queue with one hold of ready_mutex, and the CPUs
+ * picked are preempted together with force_preempt_batch().  A process that
+ * preempts a CPU is queued on that CPU's socket, so that it is the one the
+ * CPU picks.
+ * When gang scheduling, it then starts the group that has waited longest,
+ * preempting ungrouped processes to make room if it has to.  No locks are
+ * needed to set the process state as its not possible for anyone else to
+ * also access it at the same time as wake_up_batch
  */
-extern void wake_up(pcb_t* process) {
-  if (alg == StaticPriority) {
-    // Integer to keep track of which CPU is running the lowest priority proc.
-    int lowestPrioCPU = 0;
-
-    for (int id = 0; id < cpu_count; id++) {
-      pthread_mutex_lock(&current_mutex);
-
-      // If a CPU is idling, just put the process on the ready queue and
-      // addReadyProcess() will signal the CPU to run the process
-      if (current[id] == NULL) {
-        pthread_mutex_unlock(&current_mutex);
-        addReadyProcess(process);
-        return;
-      }
-      // If the CPUs are all running, find the CPU with the lowest priority
-      else if (current[id]->static_priority <
-               current[lowestPrioCPU]->static_priority) {
-        pthread_mutex_unlock(&current_mutex);
-        lowestPrioCPU = id;
-      }
-      // else loop again checking next CPU
-      pthread_mutex_unlock(&current_mutex);
-    }
+extern void wake_up_batch(pcb_t** procs, unsigned int count) {
+  int* victims = batch_victims;
+  unsigned int n, m;
 
-    // force_preempt() the CPU with the lowest priority process
-    if (current[lowestPrioCPU]->static_priority < process->static_priority) {
-      pthread_mutex_unlock(&current_mutex);
-      addReadyProcess(process);
-      force_preempt(lowestPrioCPU);
-      return;
+  // one preemption decision for the whole batch
+  if (sched->on_wake_batch != NULL) {
+    sched->on_wake_batch(procs, count, victims);
+  } else {
+    for (n = 0; n < count; n++) {
+      victims[n] = sched->on_wake != NULL ? sched->on_wake(procs[n]) : -1;
+      for (m = 0; m < n && victims[n] >= 0; m++)
+        if (victims[m] == victims[n]) victims[n] = -1;
     }
-
-    pthread_mutex_unlock(&current_mutex);
   }
-  // FIFO and Round Robin (and Static Priority if process is low priority)
-  addReadyProcess(process);
-}
 
-// gets the next process by first checking the level 1 Q, and so on...
-static pcb_t* getMultiLevelProcess(void) {
-  // ensure no other process can access ready list while we update it
-  pthread_mutex_lock(&ready_mutex);
-
-  pcb_t* first;
-  // need to find the first process;
-  if (head1 == NULL) {
-    if (head2 == NULL) {
-      if (head3 == NULL) {
-        if (head4 == NULL) {
-          pthread_mutex_unlock(&ready_mutex);
-          return NULL;
-        } else {
-          first = head4;
-          head4 = first->next;
-          first->next = NULL;
-        }
-      } else {
-        first = head3;
-        head3 = first->next;
-        first->next = NULL;
-      }
-    } else {
-      first = head2;
-      head2 = first->next;
-      first->next = NULL;
+  if (lockfree) {
+    for (n = 0; n < count; n++) {
+      enqueueLockFree(procs[n]);
+      batch[n].domain = 0;
+      batch[n].remote = 0;
+      batch[n].wake = 1;
     }
   } else {
-    first = head1;
-    head1 = first->next;
-    first->next = NULL;
+    PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+    for (n = 0; n < count; n++) {
+      batch[n].domain = victims[n] >= 0 ? (int)cpu_socket(victims[n]) : -1;
+      batch[n].wake =
+          enqueueReady(procs[n], &batch[n].domain, &batch[n].remote);
+    }
+    pthread_mutex_unlock(&ready_mutex);
   }
 
-  // if there was no next process, list is now empty, set tail to NULL
-  if (head1 == NULL) tail1 = NULL;
-  if (head2 == NULL) tail2 = NULL;
-  if (head3 == NULL) tail3 = NULL;
-  if (head4 == NULL) tail4 = NULL;
+  for (n = 0; n < count; n++) {
+    TRACE(TRACE_SUPERVISOR, TRACE_WAKE_UP, TRACE_NO_CPU, procs[n],
+          ready_count);
+    if (batch[n].wake) wakeReadyCpu(procs[n], batch[n].domain, batch[n].remote);
+  }
 
+  /* The victims reschedule in parallel */
+  for (n = 0, m = 0; n < count; n++) {
+    if (victims[n] < 0) continue;
+    TRACE(TRACE_SUPERVISOR, TRACE_FORCE_PREEMPT, victims[n],
+          sched_current(victims[n]), ready_count);
+    m++;
+  }
+  if (m > 0) force_preempt_batch(victims, count);
+
+  if (gang) gang_dispatch(-1, 1);
+}
+
+/*
+ * lock_released() is called by the simulator when a process releases a lock
+ * that another process is blocked on, just before the waiter, which now
+ * holds the lock, is woken up with the rest of the tick's wake_up_batch().
+ * What each of the two inherits is worked out again from the processes
+ * still blocked on the locks it holds.
+ */
+extern void lock_released(pcb_t* holder, pcb_t* waiter) {
+  if (!inherit || sched->on_unlock == NULL) return;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  reinherit_priority(holder);
+  reinherit_priority(waiter);
   pthread_mutex_unlock(&ready_mutex);
-  return first;
 }
 
-static void addMultiLevelProcess(pcb_t* proc) {
-  pthread_mutex_lock(&ready_mutex);
-  int prio = proc->priority;
-  if (prio == 1) {
-    if (head1 == NULL) {
-      head1 = proc;
-      tail1 = proc;
-      // pthread_cond_signal(&ready_empty);
-    } else {
-      tail1->next = proc;
-      tail1 = proc;
+/*
+ * scheduler_tick() is called by the simulator at the end of every tick while
+ * there are CPU bandwidth groups or auto-tuning is on, with the process
+ * each CPU ran during the tick.  The groups whose period ended have their
+ * held processes queued again, and the CPUs running the processes of the
+ * groups just throttled are preempted.
+ */
+extern void scheduler_tick(pcb_t** running) {
+  unsigned int released = 0, victims = 0, n;
+
+  if (cgroup_count > 0) {
+    PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+    released = cgroup_tick(running, cgroup_released, cgroup_victim, &victims);
+    for (n = 0; n < released; n++) {
+      batch[n].domain = -1;
+      batch[n].wake = enqueueReady(cgroup_released[n], &batch[n].domain,
+                                   &batch[n].remote);
     }
-  } else if (prio == 2) {
-    if (head2 == NULL) {
-      head2 = proc;
-      tail2 = proc;
-      // pthread_cond_signal(&ready_empty);
-    } else {
-      tail2->next = proc;
-      tail2 = proc;
+    pthread_mutex_unlock(&ready_mutex);
+
+    for (n = 0; n < released; n++) {
+      if (batch[n].wake)
+        wakeReadyCpu(cgroup_released[n], batch[n].domain, batch[n].remote);
     }
-  } else if (prio == 3) {
-    if (head3 == NULL) {
-      head3 = proc;
-      tail3 = proc;
-      // pthread_cond_signal(&ready_empty);
-    } else {
-      tail3->next = proc;
-      tail3 = proc;
+    for (n = 0; n < victims; n++) {
+      TRACE(TRACE_SUPERVISOR, TRACE_FORCE_PREEMPT, cgroup_victim[n],
+            sched_current(cgroup_victim[n]), ready_count);
+      force_preempt(cgroup_victim[n]);
     }
-  } else {
-    if (head4 == NULL) {
-      head4 = proc;
-      tail4 = proc;
-      // pthread_cond_signal(&ready_empty);
-    } else {
-      tail4->next = proc;
-      tail4 = proc;
+  }
+  if (tune != TUNE_OFF) tune_tick();
+}
+
+/*
+ * sched_cpu_count() and sched_current() let policies look at the CPUs
+ */
+extern unsigned int sched_cpu_count(void) { return cpu_count; }
+
+/*
+ * sched_current() gives policies a thread-safe look at current[]
+ */
+extern pcb_t* sched_current(unsigned int cpu_id) {
+  pcb_t* proc;
+
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  proc = current[cpu_id];
+  pthread_mutex_unlock(&current_mutex);
+  return proc;
+}
+
+/*
+ * save_ready_queue() is called by the simulator when it takes a checkpoint.
+ * It copies the processes on the ready queue into ready[], in the order
+ * they are queued, and returns how many there are.
+ */
+extern unsigned int save_ready_queue(pcb_t** ready) {
+  unsigned int count = 0, n;
+  pcb_t* proc;
+  int level;
+
+  if (lockfree) count = readyq_snapshot(&lockfree_queue, ready);
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  for (n = 0; n < domain_count; n++) {
+    for (level = 0; level < SCHED_LEVELS; level++) {
+      for (proc = ready_queue[n].level[level].head; proc != NULL;
+           proc = proc->next)
+        ready[count++] = proc;
     }
   }
-  proc->next = NULL;
-  proc->time_added = getSimulatorTime();
+  if (gang) count += gang_save(ready + count);
+  if (cgroup_count > 0) count += cgroup_save(ready + count);
+  pthread_mutex_unlock(&ready_mutex);
+  return count;
+}
+
+/*
+ * ready_queue_levels() is called by the supervisor each tick while the
+ * live stats are published, and counts the processes on each level of the
+ * ready queues, over all the domains.
+ */
+extern void ready_queue_levels(unsigned int* counts) {
+  unsigned int n;
+  pcb_t* proc;
+  int level;
 
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  for (level = 0; level < SCHED_LEVELS; level++) {
+    counts[level] = 0;
+    for (n = 0; n < domain_count; n++) {
+      for (proc = ready_queue[n].level[level].head; proc != NULL;
+           proc = proc->next)
+        counts[level]++;
+    }
+  }
+  if (lockfree) counts[0] += readyq_count(&lockfree_queue);
   pthread_mutex_unlock(&ready_mutex);
-  return;
 }
 
-/* The following 2 functions implement a FIFO ready queue of processes */
+/*
+ * restore_scheduler() is called by the simulator when it starts from a
+ * checkpoint, before any CPU thread runs.  The ready processes are queued
+ * again through the current policy, which need not be the one the
+ * checkpoint was taken with, and current[] is set to running[].
+ */
+extern void restore_scheduler(pcb_t** ready, unsigned int ready_count,
+                              pcb_t** running) {
+  unsigned int n;
+
+  // the live members of each group are those created and not terminated
+  for (n = 0; n < process_count; n++)
+    if (gang_member(&processes[n])) gang_restore(&processes[n]);
+  for (n = 0; n < ready_count; n++) addReadyProcess(ready[n]);
+
+  PROF_MUTEX_LOCK(&current_mutex, PROF_CURRENT_MUTEX);
+  for (n = 0; n < cpu_count; n++) current[n] = running[n];
+  pthread_mutex_unlock(&current_mutex);
+}
+
+/* The following 2 functions implement the ready queue of processes */
 
 /*
- * addReadyProcess adds a process to the end of a pseudo linked list (each
- * process struct contains a pointer next that you can use to chain them
- * together) it takes a pointer to a process as an argument and has no return
+ * addReadyProcess hands a process to the policy to put on the ready queue
+ * and marks it READY, or when gang scheduling puts a group member on its
+ * group's list.  It takes a pointer to a process as an argument and has no
+ * return
  */
-static void addReadyProcess(pcb_t* proc) {
-  // Ensure no other process can access ready list while we update it
-  pthread_mutex_lock(&ready_mutex);
-
-  // if alg is StaticPriority order queue by priority
-  if (alg == StaticPriority) {
-    pcb_t* current = head;
-    // Empty queue
-    if (head == NULL) {
-      head = proc;
-      tail = proc;
-      pthread_cond_signal(&ready_empty);  // wake up any idling CPUs
-    }
-    // One process on queue
-    else if (head->next == NULL) {
-      if (proc->static_priority > head->static_priority) {
-        pcb_t* temp = head;
-        proc->next = temp;
-        head = proc;
-        tail = proc->next;
-      } else {
-        head->next = proc;
-        tail = proc;
-      }
-    }
-    // More than one process on queue
-    else {
-      while (current->next != NULL &&
-             current->next->static_priority > proc->static_priority) {
-        current = current->next;
-      }
-      pcb_t* temp = current->next;
-      current->next = proc;
-      proc->next = temp;
-    }
-  } else {  // If not Static Priority, just add process to end of queue
-    if (head == NULL) {
-      head = proc;
-      tail = proc;
-      // if list was empty may need to wake up idle process
-      pthread_cond_signal(&ready_empty);
-    } else {
-      tail->next = proc;
-      tail = proc;
-    }
-    // ensure that this proc points to NULL
-    proc->next = NULL;
+static void addReadyProcess(pcb_t* proc) { queueReadyProcess(proc, -1); }
+
+/*
+ * queueReadyProcess is addReadyProcess onto the ready queue of the given
+ * scheduling domain, or of the process's home domain if it is -1
+ */
+static void queueReadyProcess(pcb_t* proc, int domain) {
+  unsigned int remote;
+  int wake;
+
+  if (lockfree) {
+    enqueueLockFree(proc);
+    park_wake_one();
+    return;
   }
 
-  proc->state = PROCESS_READY;
+  // Ensure no other process can access ready list while we update it
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  wake = enqueueReady(proc, &domain, &remote);
   pthread_mutex_unlock(&ready_mutex);
+
+  if (wake) wakeReadyCpu(proc, domain, remote);
 }
 
 /*
- * getReadyProcess removes a process from the front of a pseudo linked list
- * (each process struct contains a pointer next that you can use to chain them
- * together) it takes no arguments and returns the first process in the ready
- * queue, or NULL if the ready queue is empty
- *
- * TO-DO: handle priority scheduling
- *
- * THIS FUNCTION IS PARTIALLY COMPLETED - REQUIRES MODIFICATION
+ * enqueueReady does the queueing for queueReadyProcess and wake_up_batch.
+ * It sets *domain to the socket used if it was -1, and *remote to the
+ * other sockets whose idle CPUs would pull the process over, and returns
+ * whether to wake a CPU for the process.  ready_mutex must be held
  */
-static pcb_t* getReadyProcess(void) {
-  if (alg == MultiLevel) {
-    return getMultiLevelProcess();
+static int enqueueReady(pcb_t* proc, int* domain, unsigned int* remote) {
+  int wake = 1;
+
+  if (*domain < 0) *domain = home_domain(proc);
+  *remote = 0;
+  if (arrival_tick != NULL && proc->state == PROCESS_NEW)
+    arrival_tick[proc->pid] = getSimulatorTime();
+
+  if (gang_member(proc)) {
+    wake = gang_enqueue(proc);
+  } else if (cgroup_count > 0 && cgroup_held(proc)) {
+    set_process_state(proc, PROCESS_READY);
+    wake = 0;
+  } else {
+    sched->enqueue(&ready_queue[*domain], proc);
+    ready_queue[*domain].count++;
+    ready_count++;
+    if (cgroup_count > 0) cgroup_queued(proc, 1);
+    set_process_state(proc, PROCESS_READY);
+    if (energy == ENERGY_PACK) wake = pack_needs_cpu();
+    *remote = domain_remote(*domain);
   }
-  // ensure no other process can access ready list while we update it
-  pthread_mutex_lock(&ready_mutex);
+  return wake;
+}
 
-  // if list is empty, unlock and return null
-  if (head == NULL) {
-    pthread_mutex_unlock(&ready_mutex);
-    return NULL;
+/*
+ * enqueueLockFree is enqueueReady for the lock-free ready queue.  The
+ * process is READY before it is queued, as a CPU may take it at once
+ */
+static void enqueueLockFree(pcb_t* proc) {
+  if (arrival_tick != NULL && proc->state == PROCESS_NEW)
+    arrival_tick[proc->pid] = getSimulatorTime();
+  set_process_state(proc, PROCESS_READY);
+  __atomic_fetch_add(&ready_count, 1, __ATOMIC_RELAXED);
+  readyq_push(&lockfree_queue, proc,
+              sched == &sched_prio ? proc->static_priority : 0);
+}
+
+/*
+ * wakeReadyCpu wakes up an idle CPU, if there is one, to run a process
+ * just queued on the given socket
+ */
+static void wakeReadyCpu(pcb_t* proc, unsigned int domain,
+                         unsigned int remote) {
+  if (domain_count > 1 || topology.cores_per_cache < cpu_count)
+    wake_domain(proc, domain, remote);
+  else
+    park_wake_one();
+}
+
+/*
+ * getReadyProcess asks the policy for the next process to run on a CPU and
+ * removes it from the ready queue of the CPU's socket, or if that is empty
+ * and the load is out of balance, of the busiest socket.  It takes the CPU
+ * as an argument and returns that process, or NULL if there is none
+ */
+static pcb_t* getReadyProcess(unsigned int cpu_id) {
+  unsigned int domain = cpu_socket(cpu_id);
+  pcb_t* first;
+  int busiest;
+
+  if (lockfree) {
+    first = readyq_pop(&lockfree_queue);
+    if (first != NULL) __atomic_fetch_sub(&ready_count, 1, __ATOMIC_RELAXED);
+    return first;
   }
 
-  // Get first process to return and update head to point to next process.
-  // This
-  // is the same for all algorithms because Static Priority has a priority
-  // queue
-  pcb_t* first = head;
-  head = first->next;
-  first->next = NULL;
+  // ensure no other process can access ready list while we update it
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
 
-  // if there was no next process, list is now empty, set tail to NULL
-  if (head == NULL) tail = NULL;
+  if (sched->on_tick != NULL)
+    sched->on_tick(&ready_queue[domain], getSimulatorTime());
+
+  first = dequeueReady(&ready_queue[domain]);
+  if (first == NULL && (busiest = busiest_domain(domain, cpu_id)) >= 0) {
+    domain = busiest;
+    first = dequeueReady(&ready_queue[domain]);
+    if (first != NULL) domain_pulled();
+  }
+  if (first != NULL) {
+    ready_queue[domain].count--;
+    ready_count--;
+  }
 
   pthread_mutex_unlock(&ready_mutex);
   return first;
 }
 
-static void updatePriorities(void) {
-  pthread_mutex_lock(&ready_mutex);
-  unsigned int currentTime = getSimulatorTime();
-  pcb_t* currentProc;
-  for (size_t i = 1; i < 4; i++) {
-    if (i == 1) currentProc = head2;
-    if (i == 2) currentProc = head3;
-    if (i == 3) currentProc = head4;
-    while (currentProc != NULL) {
-      if (currentTime - currentProc->time_added > max_wait_time) {
-        currentProc->priority = i;
+/*
+ * dequeueReady takes the next process off a ready queue: the policy's
+ * choice, or with CPU bandwidth groups, the first in the policy's order
+ * of the group picked.  ready_mutex must be held
+ */
+static pcb_t* dequeueReady(ready_queue_t* rq) {
+  return cgroup_count > 0 ? cgroup_dequeue(rq, sched) : sched->dequeue(rq);
+}
+
+/* The following functions implement priority inheritance */
+
+/*
+ * inherit_priority lends the priority of a process that has just blocked on
+ * a lock down the chain of holders it is waiting behind, requeueing each
+ * one that is ready at its new priority
+ */
+static void inherit_priority(pcb_t* waiter) {
+  pcb_t* holder;
+  unsigned int depth = 0;
+
+  if (sched->on_block == NULL) return;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  for (holder = lock_blocker(waiter); holder != NULL && depth < process_count;
+       holder = lock_blocker(holder), depth++) {
+    if (!sched->on_block(waiter, holder)) break;
+    requeue(holder);
+    inherit_boosts++;
+    waiter = holder;
+  }
+  pthread_mutex_unlock(&ready_mutex);
+}
+
+/*
+ * reinherit_priority drops the priority a process inherited and lends it
+ * again that of each process still blocked on a lock it holds, requeueing
+ * it at its new priority if it is ready.  ready_mutex must be held
+ */
+static void reinherit_priority(pcb_t* proc) {
+  unsigned int before = proc->priority, n;
+
+  sched->on_unlock(proc);
+  for (n = 0; sched->on_block != NULL && n < process_count; n++) {
+    if (lock_blocker(&processes[n]) == proc)
+      sched->on_block(&processes[n], proc);
+  }
+  if (proc->priority != before) requeue(proc);
+}
+
+/*
+ * requeue takes a process off the ready queue it is on, if any, and hands it
+ * to the policy again.  It returns whether the process was on a queue.
+ * ready_mutex must be held
+ */
+static int requeue(pcb_t* proc) {
+  pcb_t *pos, *prev;
+  unsigned int d;
+  int level;
+
+  for (d = 0; d < domain_count; d++) {
+    for (level = 0; level < SCHED_LEVELS; level++) {
+      prev = NULL;
+      for (pos = ready_queue[d].level[level].head; pos != NULL;
+           prev = pos, pos = pos->next) {
+        if (pos != proc) continue;
+        pcb_list_remove(&ready_queue[d].level[level], prev, proc);
+        sched->enqueue(&ready_queue[d], proc);
+        return 1;
       }
-      currentProc = currentProc->next;
     }
   }
-  pthread_mutex_unlock(&ready_mutex);
+  return 0;
+}
+
+static void inherit_report(void) {
+  printf("Priority inherited by lock holders: %u times\n", inherit_boosts);
 }
@@ -12,20 +12,34 @@
 #define __STUDENT_H__
 
 #include "os-sim.h"
+#include "sched.h"
 
 /* Functions called from simulator - comments in student.c */
 extern void idle(unsigned int cpu_id);
 extern void preempt(unsigned int cpu_id);
 extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
-extern void wake_up(pcb_t* process);
+extern void wake_up_batch(pcb_t** procs, unsigned int count);
+extern void lock_released(pcb_t* holder, pcb_t* waiter);
+extern void scheduler_tick(pcb_t** running);
+
+/* Functions called from simulator to checkpoint and restore the scheduler */
+extern unsigned int save_ready_queue(pcb_t** ready);
+extern void restore_scheduler(pcb_t** ready, unsigned int ready_count,
+                              pcb_t** running);
+
+/* Function called from simulator to publish the live stats */
+extern void ready_queue_levels(unsigned int* counts);
 
 /* Functions available to use in student.c to manipulate ready queue */
 static void addReadyProcess(pcb_t* proc);
-static pcb_t* getReadyProcess(void);
-static void addMultiLevelProcess(pcb_t* proc);
-static void updatePriorities(void);
-static pcb_t* getMultiLevelProcess(void);
+static pcb_t* getReadyProcess(unsigned int cpu_id);
+
+/*
+ * current[], the ready queues and their mutexes are shared with the parts
+ * of the scheduler that have modules of their own, such as gang scheduling
+ * in sched_gang.c.  sched_cpu_count() gives them the number of CPUs.
+ */
 
 /*
  * current[] is an array of pointers to the currently running processes.
@@ -36,28 +50,20 @@ static pcb_t* getMultiLevelProcess(void);
  * will need to use a mutex to protect it.  current_mutex has been provided
  * for your use.
  */
-static pcb_t** current;
-static pthread_mutex_t current_mutex;
-
-// head and tail of ready queue
-static pcb_t* head = NULL;
-static pcb_t* tail = NULL;
-
-// head and tail of multi-level queues
-static pcb_t* head1 = NULL;
-static pcb_t* tail1 = NULL;
-static pcb_t* head2 = NULL;
-static pcb_t* tail2 = NULL;
-static pcb_t* head3 = NULL;
-static pcb_t* tail3 = NULL;
-static pcb_t* head4 = NULL;
-static pcb_t* tail4 = NULL;
+extern pcb_t** current;
+extern pthread_mutex_t current_mutex;
 
-// mutex to protect ready queue
-static pthread_mutex_t ready_mutex;
+/*
+ * The ready queues, one for each scheduling domain (socket) of the machine.
+ * The scheduling policy decides how processes are ordered on each queue's
+ * lists; ready_queue[d].count is the number of processes on queue d, and
+ * ready_count the number on all of them.
+ */
+extern ready_queue_t* ready_queue;
+extern unsigned int domain_count;
+extern unsigned int ready_count;
 
-// cond var for idle() to sleep on until a process is available on the ready
-// queue
-static pthread_cond_t ready_empty;
+// mutex to protect ready queue
+extern pthread_mutex_t ready_mutex;
 
 #endif /* __STUDENT_H__ */
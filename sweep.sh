@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# sweep.sh
+# Multithreaded OS Simulation
+#
+# Sweeps the arrival rate of an open system for each scheduler, and prints
+# one line of CSV per run, to plot response time against load:
+#
+#   scheduler,cpus,rate,jobs,completed,throughput,mean_s,p50_s,p90_s,p99_s
+#
+# rate and throughput are in jobs per second.  The jobs of the built-in
+# workload need 7.2 s of CPU on average, so one CPU saturates at about 0.14
+# jobs per second.  By default the rates load the CPUs from 20% to 100%.
+#
+# Usage: ./sweep.sh [simulator] [CPUs] [jobs] [rates...]
+#
+
+sim=${1:-./os-sim-release}
+cpus=${2:-2}
+jobs=${3:-200}
+if [ $# -gt 3 ]; then
+  shift 3
+  rates="$*"
+else
+  rates=$(awk -v cpus=$cpus 'BEGIN {
+    for (load = 0.2; load < 1.05; load += 0.1) printf "%.3f ", load * cpus / 7.2
+  }')
+fi
+
+echo "scheduler,cpus,rate,jobs,completed,throughput,mean_s,p50_s,p90_s,p99_s"
+
+for sched in "fifo:" "rr:-r 4" "priority:-p" "mlfq:-m 4 10"; do
+  name=${sched%%:*}
+  args=${sched#*:}
+  for rate in $rates; do
+    $sim $cpus $args -a $rate $jobs | tail -2 | awk -v name=$name \
+        -v cpus=$cpus -v rate=$rate -v jobs=$jobs '
+      /^Open system/ { gsub(/,/, ""); completed = $9; throughput = $12 }
+      /^Response time/ {
+        gsub(/,/, "")
+        mean = $4; p50 = $7; p90 = $10; p99 = $16
+      }
+      END {
+        printf "%s,%d,%s,%d,%d,%s,%s,%s,%s,%s\n", name, cpus, rate, jobs,
+               completed, throughput, mean, p50, p90, p99
+      }'
+  done
+done
@@ -0,0 +1,141 @@
+/*
+ * tick-bench.c
+ * Multithreaded OS Simulation
+ *
+ * Benchmark of the per-tick CPU scan in tick.c, for many more CPUs than the
+ * simulator itself runs.  It compares:
+ *
+ *   countdown : the loop the simulator used to run, which branches on each
+ *        CPU's operation type and counts its burst and time slice down.
+ *
+ *   scalar, avx2 : tick_scan() over the packed deadlines, followed by the
+ *        slow path for the due CPUs only.
+ *
+ * Every CPU gets a new burst of 1 to TICK_BENCH_BURST ticks each time its
+ * event comes, so all three do the same work on the slow path.  The output
+ * is CSV, one line per kernel and CPU count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "os-sim.h"
+#include "tick.h"
+
+#define TICK_BENCH_TICKS 200000
+#define TICK_BENCH_BURST 20
+
+/* The per-CPU state the old countdown loop worked on */
+typedef struct {
+  op_type type;
+  int time;
+  int preemption_timer;
+} countdown_cpu_t;
+
+static unsigned int bench_seed;
+
+static unsigned int next_burst(void) {
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return 1 + (bench_seed >> 16) % TICK_BENCH_BURST;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench_countdown(unsigned int cpus, unsigned long long *events) {
+  countdown_cpu_t *cpu = malloc(sizeof(countdown_cpu_t) * cpus);
+  unsigned int n, t;
+  double start;
+
+  bench_seed = 1;
+  for (n = 0; n < cpus; n++) {
+    cpu[n].type = OP_CPU;
+    cpu[n].time = next_burst();
+    cpu[n].preemption_timer = -1;
+  }
+
+  *events = 0;
+  start = now_ns();
+  for (t = 0; t < TICK_BENCH_TICKS; t++) {
+    for (n = 0; n < cpus; n++) {
+      if (cpu[n].type != OP_CPU) continue;
+      cpu[n].time--;
+      if (cpu[n].preemption_timer > 0) cpu[n].preemption_timer--;
+      if (cpu[n].time == 0 || cpu[n].preemption_timer == 0) {
+        cpu[n].time = next_burst();
+        (*events)++;
+      }
+    }
+  }
+  start = now_ns() - start;
+
+  free(cpu);
+  return start;
+}
+
+static double bench_scan(unsigned int cpus, unsigned long long *events,
+                         void (*scan)(const unsigned int *, unsigned int,
+                                      unsigned int, unsigned long long *)) {
+  unsigned int *deadline = malloc(sizeof(unsigned int) * cpus);
+  unsigned long long *due =
+      malloc(sizeof(unsigned long long) * TICK_MASK_WORDS(cpus));
+  unsigned long long bits;
+  unsigned int n, t, word;
+  double start;
+
+  /* A burst of b ticks started on tick 0 ends on tick b - 1 */
+  bench_seed = 1;
+  for (n = 0; n < cpus; n++) deadline[n] = next_burst() - 1;
+
+  *events = 0;
+  start = now_ns();
+  for (t = 0; t < TICK_BENCH_TICKS; t++) {
+    scan(deadline, cpus, t, due);
+    for (word = 0; word < TICK_MASK_WORDS(cpus); word++) {
+      for (bits = due[word]; bits != 0; bits &= bits - 1) {
+        n = word * 64 + __builtin_ctzll(bits);
+        deadline[n] = t + next_burst();
+        (*events)++;
+      }
+    }
+  }
+  start = now_ns() - start;
+
+  free(deadline);
+  free(due);
+  return start;
+}
+
+int main(void) {
+  static const unsigned int cpu_counts[] = {64, 256, 1024};
+  unsigned long long events;
+  unsigned int i, cpus;
+  double ns;
+
+  printf("kernel,cpus,ticks,events,ns_per_tick\n");
+  for (i = 0; i < sizeof(cpu_counts) / sizeof(cpu_counts[0]); i++) {
+    cpus = cpu_counts[i];
+
+    ns = bench_countdown(cpus, &events);
+    printf("countdown,%u,%u,%llu,%.1f\n", cpus, TICK_BENCH_TICKS, events,
+           ns / TICK_BENCH_TICKS);
+
+    ns = bench_scan(cpus, &events, tick_scan_scalar);
+    printf("scalar,%u,%u,%llu,%.1f\n", cpus, TICK_BENCH_TICKS, events,
+           ns / TICK_BENCH_TICKS);
+
+#ifdef TICK_HAVE_AVX2
+    if (tick_avx2_supported()) {
+      ns = bench_scan(cpus, &events, tick_scan_avx2);
+      printf("avx2,%u,%u,%llu,%.1f\n", cpus, TICK_BENCH_TICKS, events,
+             ns / TICK_BENCH_TICKS);
+    }
+#endif
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * tick.c
+ * Multithreaded OS Simulation
+ *
+ * The scalar and AVX2 versions of the per-tick deadline scan.  See tick.h
+ * for the interface.
+ */
+
+#include <string.h>
+
+#include "tick.h"
+
+#ifdef TICK_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+extern void tick_scan_scalar(const unsigned int *deadline, unsigned int n,
+                             unsigned int now, unsigned long long *mask) {
+  unsigned int i;
+
+  memset(mask, 0, sizeof(unsigned long long) * TICK_MASK_WORDS(n));
+  for (i = 0; i < n; i++) {
+    if (deadline[i] <= now) mask[i / 64] |= 1ull << (i % 64);
+  }
+}
+
+#ifdef TICK_HAVE_AVX2
+
+extern int tick_avx2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * AVX2 has no unsigned compare, but deadline <= now exactly when
+ * min(deadline, now) == deadline, and there is an unsigned min.  The
+ * movemask of each compare gives the bits of eight CPUs; eight divides 64,
+ * so they never straddle two words of the mask.
+ */
+__attribute__((target("avx2"))) extern void tick_scan_avx2(
+    const unsigned int *deadline, unsigned int n, unsigned int now,
+    unsigned long long *mask) {
+  __m256i when = _mm256_set1_epi32((int)now);
+  __m256i d, due;
+  unsigned int i;
+
+  memset(mask, 0, sizeof(unsigned long long) * TICK_MASK_WORDS(n));
+  for (i = 0; i + 8 <= n; i += 8) {
+    d = _mm256_loadu_si256((const __m256i *)&deadline[i]);
+    due = _mm256_cmpeq_epi32(_mm256_min_epu32(d, when), d);
+    mask[i / 64] |=
+        (unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(due))
+        << (i % 64);
+  }
+  for (; i < n; i++) {
+    if (deadline[i] <= now) mask[i / 64] |= 1ull << (i % 64);
+  }
+}
+
+#endif /* TICK_HAVE_AVX2 */
+
+extern void tick_scan(const unsigned int *deadline, unsigned int n,
+                      unsigned int now, unsigned long long *mask) {
+  static void (*scan)(const unsigned int *, unsigned int, unsigned int,
+                      unsigned long long *) = NULL;
+
+  /* Only the supervisor scans, so this needs no locking */
+  if (scan == NULL) {
+    scan = tick_scan_scalar;
+#ifdef TICK_HAVE_AVX2
+    if (tick_avx2_supported()) scan = tick_scan_avx2;
+#endif
+  }
+  scan(deadline, n, now, mask);
+}
@@ -0,0 +1,48 @@
+/*
+ * tick.h
+ * Multithreaded OS Simulation
+ *
+ * The per-tick scan for CPUs with an event due.
+ *
+ * Each CPU's next event, the end of its CPU burst or the expiry of its time
+ * slice, is kept as an absolute tick in a packed array with one deadline per
+ * CPU.  Every tick, tick_scan() compares the whole array with the current
+ * tick and sets a bit in a mask for each CPU whose deadline has come.  The
+ * supervisor then handles only those CPUs.  The deadlines are absolute, so
+ * nothing is counted down and the scan only ever reads the array.
+ *
+ * On x86-64 processors with AVX2 the scan compares eight CPUs at a time;
+ * elsewhere it falls back to a scalar loop.
+ *
+ * The simulator's other timed events, I/O completions and process
+ * creations, stay in the timer wheel (see timer.h).
+ */
+
+#ifndef __TICK_H__
+#define __TICK_H__
+
+/* The deadline of a CPU with nothing to do */
+#define TICK_NEVER 0xffffffffu
+
+/* Number of 64-bit words in the mask for n CPUs */
+#define TICK_MASK_WORDS(n) (((n) + 63) / 64)
+
+/*
+ * tick_scan() sets bit n of mask (bit n % 64 of word n / 64) if
+ * deadline[n] <= now, and clears it otherwise, for each of the n CPUs.
+ * It uses the fastest of the versions below that the processor supports.
+ */
+extern void tick_scan(const unsigned int *deadline, unsigned int n,
+                      unsigned int now, unsigned long long *mask);
+
+extern void tick_scan_scalar(const unsigned int *deadline, unsigned int n,
+                             unsigned int now, unsigned long long *mask);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICK_HAVE_AVX2 1
+extern int tick_avx2_supported(void);
+extern void tick_scan_avx2(const unsigned int *deadline, unsigned int n,
+                           unsigned int now, unsigned long long *mask);
+#endif
+
+#endif /* __TICK_H__ */
@@ -0,0 +1,219 @@
+/*
+ * timer.c
+ * Multithreaded OS Simulation
+ *
+ * The hierarchical timer wheel.  See timer.h for the interface.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "timer.h"
+
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+
+/* Number of ticks covered by levels 0 .. level */
+#define TIMER_RANGE(level) (1u << (TIMER_SLOT_BITS * ((level) + 1)))
+
+/* Index of the slot a tick falls into at the given level */
+#define TIMER_INDEX(tick, level) \
+  (((tick) >> (TIMER_SLOT_BITS * (level))) & TIMER_SLOT_MASK)
+
+/* Ticks are unsigned and may wrap, so compare them through a signed delta */
+#define TIMER_BEFORE_EQ(a, b) ((int)((a) - (b)) <= 0)
+
+static void list_init(sim_timer_t *head) {
+  head->next = head;
+  head->prev = head;
+}
+
+static int list_empty(sim_timer_t *head) { return head->next == head; }
+
+static void list_insert_before(sim_timer_t *pos, sim_timer_t *timer) {
+  timer->next = pos;
+  timer->prev = pos->prev;
+  pos->prev->next = timer;
+  pos->prev = timer;
+}
+
+static void list_unlink(sim_timer_t *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+/*
+ * The expired list is kept sorted by (type, key); timers that compare equal
+ * keep the order in which they expired.
+ */
+static void expired_insert(timer_wheel_t *wheel, sim_timer_t *timer) {
+  sim_timer_t *pos = wheel->expired.next;
+
+  while (pos != &wheel->expired &&
+         (pos->type < timer->type ||
+          (pos->type == timer->type && pos->key <= timer->key)))
+    pos = pos->next;
+  list_insert_before(pos, timer);
+}
+
+/* Files a timer into the wheel relative to wheel->now */
+static void wheel_insert(timer_wheel_t *wheel, sim_timer_t *timer) {
+  unsigned int expires = timer->expires;
+  unsigned int delta = expires - wheel->now;
+  int level;
+
+  if (TIMER_BEFORE_EQ(expires, wheel->now)) {
+    expired_insert(wheel, timer);
+    return;
+  }
+
+  for (level = 0; level < TIMER_LEVELS - 1; level++) {
+    if (delta < TIMER_RANGE(level)) break;
+  }
+
+  /*
+   * Timers beyond the range of the top level are parked in the top level's
+   * furthest slot and refiled when that slot is cascaded.
+   */
+  if (delta >= TIMER_RANGE(TIMER_LEVELS - 1))
+    expires = wheel->now + TIMER_RANGE(TIMER_LEVELS - 1) - 1;
+
+  list_insert_before(&wheel->slot[level][TIMER_INDEX(expires, level)], timer);
+}
+
+/* Refiles every timer in a slot of a higher level into the lower levels */
+static void cascade(timer_wheel_t *wheel, int level, unsigned int index) {
+  sim_timer_t *head = &wheel->slot[level][index];
+  sim_timer_t *timer;
+
+  while (!list_empty(head)) {
+    timer = head->next;
+    list_unlink(timer);
+    wheel_insert(wheel, timer);
+  }
+}
+
+/* Advances the wheel by exactly one tick */
+static void wheel_tick(timer_wheel_t *wheel) {
+  unsigned int now = ++wheel->now;
+  sim_timer_t *head;
+  sim_timer_t *timer;
+  int level;
+
+  /*
+   * When level 0 wraps around, pull the next slot of level 1 down, and so
+   * on up the levels for as long as they wrap around too.
+   */
+  for (level = 1; level < TIMER_LEVELS; level++) {
+    if (TIMER_INDEX(now, level - 1) != 0) break;
+    cascade(wheel, level, TIMER_INDEX(now, level));
+  }
+
+  head = &wheel->slot[0][TIMER_INDEX(now, 0)];
+  while (!list_empty(head)) {
+    timer = head->next;
+    list_unlink(timer);
+    expired_insert(wheel, timer);
+  }
+}
+
+extern void timer_wheel_init(timer_wheel_t *wheel, unsigned int now) {
+  int level, n;
+
+  wheel->now = now;
+  wheel->count = 0;
+  for (level = 0; level < TIMER_LEVELS; level++)
+    for (n = 0; n < TIMER_SLOTS; n++) list_init(&wheel->slot[level][n]);
+  list_init(&wheel->expired);
+}
+
+extern void timer_init(sim_timer_t *timer, timer_type_t type,
+                       unsigned int key) {
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expires = 0;
+  timer->type = type;
+  timer->key = key;
+  timer->pending = 0;
+}
+
+extern void timer_add(timer_wheel_t *wheel, sim_timer_t *timer,
+                      unsigned int expires) {
+  timer_del(wheel, timer);
+  timer->expires = expires;
+  timer->pending = 1;
+  wheel->count++;
+  wheel_insert(wheel, timer);
+}
+
+extern void timer_del(timer_wheel_t *wheel, sim_timer_t *timer) {
+  if (!timer->pending) return;
+
+  list_unlink(timer);
+  timer->pending = 0;
+  wheel->count--;
+}
+
+extern void timer_wheel_advance(timer_wheel_t *wheel, unsigned int now) {
+  while (!TIMER_BEFORE_EQ(now, wheel->now)) {
+    if (wheel->count == 0) {
+      /* Nothing to expire on the way, so jump straight there */
+      wheel->now = now;
+      break;
+    }
+    wheel_tick(wheel);
+  }
+}
+
+extern sim_timer_t *timer_expired(timer_wheel_t *wheel, timer_type_t type) {
+  sim_timer_t *timer = wheel->expired.next;
+
+  if (timer == &wheel->expired || timer->type != type) return NULL;
+
+  list_unlink(timer);
+  timer->pending = 0;
+  wheel->count--;
+  return timer;
+}
+
+extern int timer_next_expiry(timer_wheel_t *wheel, unsigned int *when) {
+  sim_timer_t *head;
+  sim_timer_t *timer;
+  unsigned int best = 0;
+  int found = 0;
+  int level, n;
+
+  if (wheel->count == 0) return 0;
+
+  if (!list_empty(&wheel->expired)) {
+    *when = wheel->now;
+    return 1;
+  }
+
+  /*
+   * Within a level, later slots hold later timers, so the first non-empty
+   * slot after the current one holds that level's earliest timer.  A slot
+   * of level 0 holds timers for exactly one tick; a slot of a higher level
+   * has to be searched.
+   */
+  for (level = 0; level < TIMER_LEVELS; level++) {
+    for (n = 1; n <= TIMER_SLOTS; n++) {
+      head = &wheel->slot[level][(TIMER_INDEX(wheel->now, level) + n) &
+                                 TIMER_SLOT_MASK];
+      if (list_empty(head)) continue;
+
+      for (timer = head->next; timer != head; timer = timer->next) {
+        if (!found || TIMER_BEFORE_EQ(timer->expires, best)) {
+          best = timer->expires;
+          found = 1;
+        }
+      }
+      break;
+    }
+  }
+
+  assert(found);
+  *when = best;
+  return 1;
+}
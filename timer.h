@@ -0,0 +1,120 @@
+/*
+ * timer.h
+ * Multithreaded OS Simulation
+ *
+ * A hierarchical timer wheel for the simulator's I/O and creation events.
+ *
+ * The completion of an I/O request and the creation of a process happen at
+ * a known future tick, and register a sim_timer_t with the wheel.  Each
+ * tick the supervisor advances the wheel, which moves only the timers that
+ * expire on that tick onto the expired list, so the cost of a tick does not
+ * grow with the number of pending requests.
+ *
+ * The CPUs' events, the end of a CPU burst and the expiry of a time slice,
+ * are not in the wheel.  There is one per running CPU, it moves on every
+ * context switch, and the supervisor wants all of those due each tick, so
+ * they are kept as a packed array of deadlines that tick_scan() reads in
+ * one pass instead (see tick.h).
+ *
+ * The wheel has TIMER_LEVELS levels of TIMER_SLOTS slots each.  Level 0
+ * holds timers which expire within the next TIMER_SLOTS ticks, one slot per
+ * tick; each higher level covers TIMER_SLOTS times the range of the level
+ * below it and is cascaded down as time reaches it.
+ *
+ * The wheel is not thread-safe; the simulator only touches it while holding
+ * simulator_mutex.
+ */
+
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+/*
+ * The timer types.  Timers which expire on the same tick are handed out
+ * ordered by type and then by key, so the order here is the order in which
+ * the supervisor handles the events of a tick.
+ */
+typedef enum {
+  TIMER_IO = 0,
+  TIMER_CREAT
+} timer_type_t;
+
+/*
+ * A timer.  Timers are embedded in the structure that owns the event (the
+ * per-CPU data, an I/O request, ...), so the wheel never allocates memory.
+ *
+ *   expires : the tick on which the timer expires. (read-only)
+ *
+ *   type : what kind of event the timer is for.
+ *
+ *   key : orders timers of the same type expiring on the same tick, lowest
+ *        first.
+ *
+ *   pending : non-zero while the timer is in the wheel or on the expired
+ *        list. (read-only)
+ */
+typedef struct _sim_timer {
+  struct _sim_timer *next;
+  struct _sim_timer *prev;
+  unsigned int expires;
+  timer_type_t type;
+  unsigned int key;
+  int pending;
+} sim_timer_t;
+
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4
+
+typedef struct {
+  unsigned int now;
+  unsigned int count;
+  sim_timer_t slot[TIMER_LEVELS][TIMER_SLOTS];
+  sim_timer_t expired;
+} timer_wheel_t;
+
+/*
+ * timer_wheel_init() empties the wheel and sets its current tick.
+ */
+extern void timer_wheel_init(timer_wheel_t *wheel, unsigned int now);
+
+/*
+ * timer_init() prepares a timer for use.  It must be called once before the
+ * timer is first added.
+ */
+extern void timer_init(sim_timer_t *timer, timer_type_t type,
+                       unsigned int key);
+
+/*
+ * timer_add() (re)arms a timer to expire on the given tick.  A timer that
+ * expires on or before the wheel's current tick goes straight to the
+ * expired list.
+ */
+extern void timer_add(timer_wheel_t *wheel, sim_timer_t *timer,
+                      unsigned int expires);
+
+/*
+ * timer_del() disarms a timer.  It is safe to call on a timer that is not
+ * pending.
+ */
+extern void timer_del(timer_wheel_t *wheel, sim_timer_t *timer);
+
+/*
+ * timer_wheel_advance() moves the wheel forward to the given tick, putting
+ * every timer that expires on the way onto the expired list.
+ */
+extern void timer_wheel_advance(timer_wheel_t *wheel, unsigned int now);
+
+/*
+ * timer_expired() removes and returns the first expired timer of the given
+ * type, or NULL if there is none.
+ */
+extern sim_timer_t *timer_expired(timer_wheel_t *wheel, timer_type_t type);
+
+/*
+ * timer_next_expiry() stores the tick of the earliest pending timer in
+ * *when and returns 1, or returns 0 if no timer is pending.  This is the
+ * lookup a fast-forward loop uses to skip ticks on which nothing happens.
+ */
+extern int timer_next_expiry(timer_wheel_t *wheel, unsigned int *when);
+
+#endif /* __TIMER_H__ */
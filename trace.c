@@ -0,0 +1,190 @@
+/*
+ * trace.c
+ * Multithreaded OS Simulation
+ *
+ * The event trace recorder and its Chrome trace-event exporter.  See
+ * trace.h for the interface.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os-sim.h"
+#include "process.h"
+#include "trace.h"
+
+/* Events per ring; the supervisor drains the rings every tick */
+#define TRACE_RING_SIZE 4096
+
+/* Length of a tick in the microseconds used by the trace-event format */
+#define TRACE_TICK_US 100000
+
+/*
+ * A single-producer, single-consumer ring.  The producer only writes head
+ * and the consumer only writes tail, so neither needs a lock.  An event
+ * recorded while the ring is full is counted in dropped and discarded.
+ */
+typedef struct {
+  _Atomic unsigned int head;
+  _Atomic unsigned int tail;
+  unsigned int dropped;
+  trace_event_t event[TRACE_RING_SIZE];
+} trace_ring_t;
+
+int trace_enabled = 0;
+
+static FILE *trace_file;
+static trace_ring_t *trace_ring;
+static unsigned int trace_rings;
+static unsigned int trace_last_time;
+
+/* The process each CPU is running in the exported trace, and since when */
+static int *trace_cpu_pid;
+static unsigned int *trace_cpu_since;
+
+static const char *trace_event_name[] = {
+    "context_switch", "force_preempt", "preempt",          "yield",
+    "terminate",      "wake_up",       "submit_io_request"};
+
+static void trace_close(void);
+
+extern int trace_open(const char *path, unsigned int cpu_count) {
+  unsigned int n;
+
+  trace_file = fopen(path, "w");
+  if (trace_file == NULL) return -1;
+
+  /* One ring per CPU thread, and the last one for the supervisor */
+  trace_rings = cpu_count + 1;
+  trace_ring = calloc(trace_rings, sizeof(trace_ring_t));
+  assert(trace_ring != NULL);
+  trace_cpu_pid = malloc(sizeof(int) * cpu_count);
+  assert(trace_cpu_pid != NULL);
+  trace_cpu_since = calloc(cpu_count, sizeof(unsigned int));
+  assert(trace_cpu_since != NULL);
+
+  fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(trace_file,
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+          "\"args\":{\"name\":\"os-sim\"}}");
+  for (n = 0; n < cpu_count; n++) {
+    trace_cpu_pid[n] = -1;
+    fprintf(trace_file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+            "\"args\":{\"name\":\"CPU %u\"}}",
+            n, n);
+  }
+  fprintf(trace_file,
+          ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+          "\"args\":{\"name\":\"supervisor\"}}",
+          cpu_count);
+
+  atexit(trace_close);
+  trace_enabled = 1;
+  return 0;
+}
+
+extern void trace_record(unsigned int ring, trace_event_type_t type,
+                         unsigned int cpu, const pcb_t *pcb,
+                         unsigned int queue_length) {
+  trace_ring_t *r;
+  trace_event_t *e;
+  unsigned int head;
+
+  if (ring == TRACE_SUPERVISOR || ring >= trace_rings) ring = trace_rings - 1;
+  r = &trace_ring[ring];
+
+  head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&r->tail, memory_order_acquire) >=
+      TRACE_RING_SIZE) {
+    r->dropped++;
+    return;
+  }
+
+  e = &r->event[head % TRACE_RING_SIZE];
+  e->time = getSimulatorTime();
+  e->pid = pcb != NULL ? (int)pcb->pid : -1;
+  e->queue_length = queue_length;
+  e->cpu = cpu;
+  e->type = type;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/* Closes the slice of the process running on a CPU in the exported trace */
+static void trace_end_slice(unsigned int cpu, unsigned int time) {
+  if (trace_cpu_pid[cpu] < 0) return;
+
+  fprintf(trace_file,
+          ",\n{\"name\":\"%s\",\"cat\":\"run\",\"ph\":\"X\",\"ts\":%llu,"
+          "\"dur\":%llu,\"pid\":0,\"tid\":%u,\"args\":{\"pid\":%d}}",
+          processes[trace_cpu_pid[cpu]].name,
+          (unsigned long long)trace_cpu_since[cpu] * TRACE_TICK_US,
+          (unsigned long long)(time - trace_cpu_since[cpu]) * TRACE_TICK_US,
+          cpu, trace_cpu_pid[cpu]);
+  trace_cpu_pid[cpu] = -1;
+}
+
+static void trace_export(const trace_event_t *e, unsigned int tid) {
+  unsigned long long ts = (unsigned long long)e->time * TRACE_TICK_US;
+
+  if (e->time > trace_last_time) trace_last_time = e->time;
+
+  /*
+   * Context switches become one slice per process run on the CPU's track;
+   * everything else is an instant event on the track of the thread that
+   * recorded it.
+   */
+  if (e->type == TRACE_CONTEXT_SWITCH && e->cpu != TRACE_NO_CPU) {
+    trace_end_slice(e->cpu, e->time);
+    trace_cpu_pid[e->cpu] = e->pid;
+    trace_cpu_since[e->cpu] = e->time;
+  }
+
+  fprintf(trace_file,
+          ",\n{\"name\":\"%s\",\"cat\":\"sched\",\"ph\":\"i\",\"s\":\"t\","
+          "\"ts\":%llu,\"pid\":0,\"tid\":%u,\"args\":{\"pid\":%d,"
+          "\"process\":\"%s\",\"cpu\":%d,\"queue_length\":%u}}",
+          trace_event_name[e->type], ts, tid, e->pid,
+          e->pid >= 0 ? processes[e->pid].name : "(IDLE)",
+          e->cpu == TRACE_NO_CPU ? -1 : (int)e->cpu, e->queue_length);
+
+  fprintf(trace_file,
+          ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%llu,\"pid\":0,"
+          "\"args\":{\"length\":%u}}",
+          e->type == TRACE_IO_REQUEST ? "I/O queue" : "ready queue", ts,
+          e->queue_length);
+}
+
+extern void trace_drain(void) {
+  trace_ring_t *r;
+  unsigned int n, head, tail;
+
+  for (n = 0; n < trace_rings; n++) {
+    r = &trace_ring[n];
+    head = atomic_load_explicit(&r->head, memory_order_acquire);
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (tail != head) {
+      trace_export(&r->event[tail % TRACE_RING_SIZE], n);
+      tail++;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+  }
+}
+
+static void trace_close(void) {
+  unsigned int n, dropped = 0;
+
+  if (!trace_enabled) return;
+
+  trace_drain();
+  trace_enabled = 0;
+  for (n = 0; n < trace_rings - 1; n++) trace_end_slice(n, trace_last_time);
+  for (n = 0; n < trace_rings; n++) dropped += trace_ring[n].dropped;
+
+  fprintf(trace_file, "\n]}\n");
+  fclose(trace_file);
+  if (dropped > 0)
+    fprintf(stderr, "trace: %u events dropped, rings were full\n", dropped);
+}
@@ -0,0 +1,90 @@
+/*
+ * trace.h
+ * Multithreaded OS Simulation
+ *
+ * Structured event trace of scheduler decisions.
+ *
+ * Every traced call writes a fixed-size trace_event_t into a ring buffer
+ * owned by the thread that made it: one ring per CPU thread and one for the
+ * supervisor thread.  Each ring has exactly one producer and one consumer,
+ * so recording an event never takes a lock; in particular it never takes
+ * simulator_mutex.  The supervisor drains all rings once per tick and writes
+ * the events to a file in the Chrome trace-event JSON format, which can be
+ * opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * When no trace file was given, TRACE() costs a single test of trace_enabled.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "os-sim.h"
+
+typedef enum {
+  TRACE_CONTEXT_SWITCH = 0,
+  TRACE_FORCE_PREEMPT,
+  TRACE_PREEMPT,
+  TRACE_YIELD,
+  TRACE_TERMINATE,
+  TRACE_WAKE_UP,
+  TRACE_IO_REQUEST
+} trace_event_type_t;
+
+/*
+ * A trace record.
+ *
+ *   time : the simulator tick the event happened on.
+ *
+ *   pid : the process the event is about, or -1 for the idle process.
+ *
+ *   queue_length : the length of the ready queue after the event, or of
+ *        the I/O queue for TRACE_IO_REQUEST.
+ *
+ *   cpu : the CPU the event happened on, or TRACE_NO_CPU.
+ *
+ *   type : a trace_event_type_t.
+ */
+typedef struct {
+  unsigned int time;
+  int pid;
+  unsigned int queue_length;
+  unsigned short cpu;
+  unsigned short type;
+} trace_event_t;
+
+#define TRACE_NO_CPU 0xffff
+
+/* Ring used by the supervisor thread (wake_up_batch(), I/O requests, ...) */
+#define TRACE_SUPERVISOR ((unsigned int)-1)
+
+extern int trace_enabled;
+
+/*
+ * TRACE() records an event in the ring of the calling thread.  ring is the
+ * caller's cpu_id, or TRACE_SUPERVISOR when called on the supervisor thread.
+ */
+#define TRACE(ring, type, cpu, pcb, queue_length)       \
+  do {                                                  \
+    if (trace_enabled)                                  \
+      trace_record(ring, type, cpu, pcb, queue_length); \
+  } while (0)
+
+/*
+ * trace_open() starts tracing to the given file, with one ring for each of
+ * cpu_count CPU threads plus the supervisor.  The trace is finished
+ * automatically when the simulator exits.  Returns 0 on success, -1 if the
+ * file could not be opened.
+ */
+extern int trace_open(const char *path, unsigned int cpu_count);
+
+extern void trace_record(unsigned int ring, trace_event_type_t type,
+                         unsigned int cpu, const pcb_t *pcb,
+                         unsigned int queue_length);
+
+/*
+ * trace_drain() empties every ring into the trace file.  It must only be
+ * called from one thread, the supervisor.
+ */
+extern void trace_drain(void);
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,201 @@
+/*
+ * tune.c
+ * Multithreaded OS Simulation
+ *
+ * The bandit behind auto-tuning.  See tune.h for the interface.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "os-sim.h"
+#include "process.h"
+#include "prof.h"
+#include "sched.h"
+#include "student.h"
+#include "tune.h"
+
+static const int tune_slices[] = {1, 2, 3, 4, 6, 8, 12, 16};
+static const int tune_waits[] = {5, 10, 20, 40, 80};
+
+#define TUNE_SLICES (sizeof(tune_slices) / sizeof(tune_slices[0]))
+#define TUNE_WAITS (sizeof(tune_waits) / sizeof(tune_waits[0]))
+#define TUNE_ARMS (TUNE_SLICES * TUNE_WAITS)
+
+typedef struct {
+  tune_arm_t arm;
+  unsigned int windows;
+  double total;
+} tune_stats_t;
+
+static tune_stats_t tune_arm[TUNE_ARMS];
+static unsigned int tune_arms, tune_windows = 0;
+static int tune_aging;
+static const char *tune_metric;
+static tune_stats_t *tune_now;
+
+static void tune_report(void);
+
+static double tune_mean(const tune_stats_t *a) {
+  return a->total / a->windows;
+}
+
+extern void tune_init(int aging, int time_slice, int max_wait_time,
+                      const char *metric) {
+  unsigned int s, w, n, first = 0;
+  int distance, best = -1;
+
+  tune_aging = aging;
+  tune_metric = metric;
+  tune_arms = 0;
+  for (s = 0; s < TUNE_SLICES; s++) {
+    for (w = 0; w < (aging ? TUNE_WAITS : 1); w++) {
+      tune_arm[tune_arms].arm.time_slice = tune_slices[s];
+      tune_arm[tune_arms].arm.max_wait_time = aging ? tune_waits[w] : 0;
+      tune_arms++;
+    }
+  }
+
+  for (n = 0; n < tune_arms; n++) {
+    distance = abs(tune_arm[n].arm.time_slice - time_slice) +
+               abs(tune_arm[n].arm.max_wait_time - max_wait_time) * aging;
+    if (best < 0 || distance < best) {
+      best = distance;
+      first = n;
+    }
+  }
+  tune_now = &tune_arm[first];
+  atexit(tune_report);
+}
+
+extern const tune_arm_t *tune_current(void) { return &tune_now->arm; }
+
+extern const tune_arm_t *tune_record(double cost) {
+  double lowest = 0.0, highest = 0.0, bound, best = 0.0;
+  unsigned int n;
+
+  tune_now->windows++;
+  tune_now->total += cost;
+  tune_windows++;
+
+  // arms not yet run go first, in grid order
+  for (n = 0; n < tune_arms; n++) {
+    if (tune_arm[n].windows == 0) {
+      tune_now = &tune_arm[n];
+      return &tune_now->arm;
+    }
+    if (n == 0 || tune_mean(&tune_arm[n]) < lowest)
+      lowest = tune_mean(&tune_arm[n]);
+    if (n == 0 || tune_mean(&tune_arm[n]) > highest)
+      highest = tune_mean(&tune_arm[n]);
+  }
+  if (highest == lowest) highest = lowest + 1.0;
+
+  for (n = 0; n < tune_arms; n++) {
+    bound = (tune_mean(&tune_arm[n]) - lowest) / (highest - lowest) -
+            sqrt(2.0 * log(tune_windows) / tune_arm[n].windows);
+    if (n == 0 || bound < best) {
+      best = bound;
+      tune_now = &tune_arm[n];
+    }
+  }
+  return &tune_now->arm;
+}
+
+static void tune_report(void) {
+  tune_stats_t *best = NULL;
+  unsigned int n;
+
+  printf("Auto-tune on %s, %u windows:\n", tune_metric, tune_windows);
+  for (n = 0; n < tune_arms; n++) {
+    if (tune_arm[n].windows == 0) continue;
+    if (best == NULL || tune_arm[n].windows > best->windows ||
+        (tune_arm[n].windows == best->windows &&
+         tune_mean(&tune_arm[n]) < tune_mean(best)))
+      best = &tune_arm[n];
+    printf("  time slice %2d", tune_arm[n].arm.time_slice);
+    if (tune_aging) printf(", max wait %2d", tune_arm[n].arm.max_wait_time);
+    printf(": %3u windows, mean %.3f\n", tune_arm[n].windows,
+           tune_mean(&tune_arm[n]));
+  }
+  if (best == NULL) return;
+  printf("Converged on time slice %d", best->arm.time_slice);
+  if (tune_aging) printf(", max wait %d", best->arm.max_wait_time);
+  printf("\n");
+}
+
+/* The following functions measure the scheduler for auto-tuning */
+
+tune_metric_t tune = TUNE_OFF;
+
+/*
+ * The window started on tune_start, and the READY processes summed over its
+ * ticks, its context switches, and the turnaround of the processes that
+ * terminated in it so far
+ */
+static unsigned int tune_window, tune_start = 0;
+static unsigned int tune_switches = 0, tune_done_count = 0;
+static unsigned long long tune_ready_ticks = 0;
+static unsigned int *tune_done;
+
+extern void tune_begin(const char *metric, unsigned int window, int aging) {
+  const tune_arm_t *arm;
+
+  tune_window = window;
+  tune_done = malloc(sizeof(unsigned int) * process_count);
+  assert(tune_done != NULL);
+  tune_init(aging, time_slice, max_wait_time, metric);
+  arm = tune_current();
+  time_slice = arm->time_slice;
+  if (tune_aging) max_wait_time = arm->max_wait_time;
+  simulator_scheduler_tick();
+}
+
+/*
+ * The policies read max_wait_time under ready_mutex, but time_slice without
+ * it, so time_slice is stored atomically
+ */
+extern void tune_tick(void) {
+  unsigned int now = getSimulatorTime() + 1, ticks;
+  const tune_arm_t *arm;
+  double cost;
+
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  tune_ready_ticks += __atomic_load_n(&ready_count, __ATOMIC_RELAXED);
+  ticks = now - tune_start;
+  if (ticks < tune_window || (tune == TUNE_P99 && tune_done_count == 0)) {
+    pthread_mutex_unlock(&ready_mutex);
+    return;
+  }
+
+  if (tune == TUNE_READY) {
+    cost = (double)tune_ready_ticks / ticks;
+  } else if (tune == TUNE_P99) {
+    sort_ticks(tune_done, tune_done_count);
+    cost = tick_percentile(tune_done, tune_done_count, 99) / 10.0;
+  } else {
+    cost = (double)__atomic_exchange_n(&tune_switches, 0, __ATOMIC_RELAXED) /
+           ticks;
+  }
+
+  arm = tune_record(cost);
+  __atomic_store_n(&time_slice, arm->time_slice, __ATOMIC_RELAXED);
+  if (tune_aging) max_wait_time = arm->max_wait_time;
+  tune_start = now;
+  tune_ready_ticks = 0;
+  tune_done_count = 0;
+  pthread_mutex_unlock(&ready_mutex);
+}
+
+extern void tune_switched(void) {
+  __atomic_fetch_add(&tune_switches, 1, __ATOMIC_RELAXED);
+}
+
+extern void tune_terminated(unsigned int arrival) {
+  PROF_MUTEX_LOCK(&ready_mutex, PROF_READY_MUTEX);
+  tune_done[tune_done_count++] = getSimulatorTime() - arrival;
+  pthread_mutex_unlock(&ready_mutex);
+}
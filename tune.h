@@ -0,0 +1,91 @@
+/*
+ * tune.h
+ * Multithreaded OS Simulation
+ *
+ * Online tuning of the time slice and the MLFQ aging time, as a
+ * multi-armed bandit.
+ *
+ * Each arm is a pair of time_slice and max_wait_time values from a fixed
+ * grid.  The run is cut into windows of simulated ticks; each window runs
+ * one arm, and its cost is a metric measured over the window, lower being
+ * better.  Every arm is tried once, starting with the values given on the
+ * command line, and after that each window goes to the arm with the lowest
+ * UCB1 bound: its mean cost, scaled so that the best mean so far is 0 and
+ * the worst 1, less sqrt(2 ln(windows) / its windows).  So arms that have
+ * done well are run more, while the others are still tried now and then in
+ * case a window was unlucky.  The arm run for the most windows is the one
+ * converged on.
+ *
+ * tune_init(), tune_current() and tune_record() only do the bookkeeping,
+ * for a caller that measures the cost and sets the parameters.
+ * tune_begin() and the functions after it are that caller for the
+ * scheduler in student.c.
+ */
+
+#ifndef __TUNE_H__
+#define __TUNE_H__
+
+typedef struct {
+  int time_slice;
+  int max_wait_time;
+} tune_arm_t;
+
+/*
+ * tune_init() builds the arms: time slices only if aging is 0, or time
+ * slices and aging times.  The first arm run is the one nearest the given
+ * values.  metric names the cost in the report printed at exit.
+ */
+extern void tune_init(int aging, int time_slice, int max_wait_time,
+                      const char *metric);
+
+/* tune_current() returns the arm for the window now running */
+extern const tune_arm_t *tune_current(void);
+
+/*
+ * tune_record() records the cost of the window just ended, picks the arm
+ * for the next one, and returns it.
+ */
+extern const tune_arm_t *tune_record(double cost);
+
+/*
+ * Auto-tuning the scheduler (-T).  The run is cut into windows of the given
+ * number of ticks, and the bandit picks the time slice, and for MLFQ the
+ * aging time, for each one.  The cost of a window is one of: the mean
+ * number of processes READY over it, the 99th percentile turnaround of the
+ * processes that terminated in it, or its context switches per tick.  When
+ * tuning on the percentile, a window in which nothing terminated runs on
+ * until something does.
+ */
+typedef enum {
+  TUNE_OFF = 0,
+  TUNE_READY,
+  TUNE_P99,
+  TUNE_SWITCHES
+} tune_metric_t;
+
+/* Set by -T */
+extern tune_metric_t tune;
+
+/*
+ * tune_begin() sets up the bandit, starting from the time slice and aging
+ * time on the command line, and has the supervisor call scheduler_tick().
+ * aging is set for MLFQ, whose max_wait_time is tuned too.
+ */
+extern void tune_begin(const char *metric, unsigned int window, int aging);
+
+/*
+ * tune_tick() is called by the supervisor every tick.  At the end of a
+ * window it scores the window, and sets the parameters the bandit picks for
+ * the next one.  It takes ready_mutex.
+ */
+extern void tune_tick(void);
+
+/*
+ * tune_switched() counts a context switch, for TUNE_SWITCHES, and
+ * tune_terminated() the turnaround of a process that has just terminated,
+ * having arrived on the given tick, for TUNE_P99.
+ */
+extern void tune_switched(void);
+extern void tune_terminated(unsigned int arrival);
+
+#endif /* __TUNE_H__ */